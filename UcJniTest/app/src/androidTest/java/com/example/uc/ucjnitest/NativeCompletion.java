@@ -0,0 +1,19 @@
+package com.example.uc.ucjnitest;
+
+import java.util.function.BiConsumer;
+
+/**
+ * Completion callback of uc::jni::awaitable(). bound by uc::jni::register_completion_callback().
+ */
+
+final class NativeCompletion implements BiConsumer<Object, Throwable> {
+    private final long handle;
+
+    NativeCompletion(long handle)
+    {
+        this.handle = handle;
+    }
+
+    @Override
+    public native void accept(Object value, Throwable error);
+}
@@ -9,6 +9,9 @@ import org.junit.Test;
 
 import java.util.HashMap;
 import java.util.Map;
+import java.util.concurrent.CompletableFuture;
+import java.util.concurrent.ExecutionException;
+import java.util.function.Supplier;
 
 import static org.junit.Assert.*;
 /**
@@ -17,6 +20,7 @@ import static org.junit.Assert.*;
 public class UcJniTest {
     static {
         System.loadLibrary("native-lib");
+        System.loadLibrary("native-lib-cpp20");
     }
     class InnerA
     {
@@ -325,6 +329,67 @@ public class UcJniTest {
     @Test public native void testCustomTraits() throws Exception;
     @Test public native void testCustomTraits2() throws Exception;
 
+    @Test public native void testMetrics() throws Exception;
+    @Test public native void testTrace() throws Exception;
+    @Test public native void testRefStats() throws Exception;
+    @Test public native void testCopyStats() throws Exception;
+    @Test public native void testAllocationBudgets() throws Exception;
+    @Test public native void testExplicitEnv() throws Exception;
+    @Test public native void testEnvAcquisition() throws Exception;
+    @Test public native void testThreadPool() throws Exception;
+    @Test public native void testAwaitCompletion() throws Exception;
+
+    @Test public void testAsync() throws Exception
+    {
+        assertEquals("Hello, World", concatAsync("Hello", "World").get());
+        assertEquals(Integer.valueOf(42), sumAsync(40, 2).get());
+        assertEquals(Integer.valueOf(123), parseAsync("123").get());
+        try {
+            parseAsync("not a number").get();
+            fail();
+        } catch (final ExecutionException e) {
+            assertTrue(e.getCause() instanceof NumberFormatException);
+        }
+        try {
+            failAsync("std::runtime_error").get();
+            fail();
+        } catch (final ExecutionException e) {
+            assertTrue(e.getCause() instanceof RuntimeException);
+            assertEquals("std::runtime_error", e.getCause().getMessage());
+        }
+    }
+    public native CompletableFuture<String> concatAsync(String a, String b);
+    public native CompletableFuture<Integer> sumAsync(int a, int b);
+    public native CompletableFuture<Integer> parseAsync(String str);
+    public native CompletableFuture<Void> failAsync(String message);
+
+    @Test public native void testUpcallChannel() throws Exception;
+    static int eventCount = 0;
+    static int eventBatches = 0;
+    static long eventSum = 0;
+    static String lastEvent;
+    static void onEvents(int count, int[] ids, long[] values, String[] messages)
+    {
+        ++eventBatches;
+        eventCount += count;
+        for (int i = 0; i < count; ++i) {
+            eventSum += ids[i] + values[i];
+        }
+        lastEvent = messages[count - 1];
+    }
+
+    @Test public native void testRingBuffer() throws Exception;
+    @Test public native void testIdentityLocks() throws Exception;
+    @Test public native void testUniqueRefs() throws Exception;
+    @Test public native void testLocalFrame() throws Exception;
+    @Test public native void testAdoptedResults() throws Exception;
+    @Test public native void testHandleTable() throws Exception;
+    @Test public native void testPeerRegistry() throws Exception;
+    @Test public native void testIdentityMap() throws Exception;
+    @Test public native void testObjectPool() throws Exception;
+    @Test public native void testClassCache() throws Exception;
+    @Test public native void testIdRegistry() throws Exception;
+
     HashMap getHashMap()
     {
         HashMap<String, Integer> v = new HashMap<>();
@@ -343,4 +408,23 @@ public class UcJniTest {
     void testDoNothing(String string) {
         // do nothing.
     }
+
+    CompletableFuture<String> supplyLater(final String value)
+    {
+        return CompletableFuture.supplyAsync(new Supplier<String>() {
+            @Override
+            public String get() {
+                return value;
+            }
+        });
+    }
+    CompletableFuture<String> failLater(final String message)
+    {
+        return CompletableFuture.supplyAsync(new Supplier<String>() {
+            @Override
+            public String get() {
+                throw new IllegalStateException(message);
+            }
+        });
+    }
 }
\ No newline at end of file
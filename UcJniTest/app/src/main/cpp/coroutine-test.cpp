@@ -0,0 +1,120 @@
+// Coroutine Support tests. built with -std=c++20 as native-lib-cpp20 (see CMakeLists.txt);
+// native-lib.cpp stays C++14.
+#define UC_JNI_ENABLE_THREAD_POOL
+#include "../../../../../uc-jni.hpp"
+#include <string>
+#include <stdexcept>
+#include <future>
+
+#if !defined(__cpp_impl_coroutine)
+#error "coroutine-test.cpp must be built with C++20 coroutines"
+#endif
+
+#define TO_STRING_(n)	#n
+#define TO_STRING(n)	TO_STRING_(n)
+#define CODE_POSITION	__FILE__ ":" TO_STRING( __LINE__ )
+#define JNI(ret, name) extern "C" JNIEXPORT ret JNICALL Java_com_example_uc_ucjnitest_UcJniTest_ ## name
+
+#define TEST_ASSERT(pred) if (!(pred)) { throw std::runtime_error(#pred "\nat " CODE_POSITION); }
+#define TEST_ASSERT_EQUALS(expected, actual) TEST_ASSERT(expected == actual)
+
+UC_JNI_DEFINE_JCLASS_ALIAS(UcJniTest, com/example/uc/ucjnitest/UcJniTest);
+UC_JNI_DEFINE_JCLASS_ALIAS(NativeCompletion, com/example/uc/ucjnitest/NativeCompletion);
+UC_JNI_DEFINE_JCLASS_ALIAS(IllegalStateException, java/lang/IllegalStateException);
+UC_JNI_DEFINE_JCLASS_ALIAS(CompletableFuture, java/util/concurrent/CompletableFuture);
+
+jint JNI_OnLoad(JavaVM * vm, void * /*reserved*/)
+{
+    uc::jni::java_vm(vm);
+    uc::jni::replace_with_class_loader_find_class<UcJniTest>();
+    return JNI_VERSION_1_6;
+}
+
+//*************************************************************************************************
+// Coroutine Support
+//*************************************************************************************************
+struct detached_task
+{
+    struct promise_type
+    {
+        detached_task get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+//! destroys the coroutine frame with the task, wherever it is suspended.
+struct owned_task
+{
+    struct promise_type
+    {
+        owned_task get_return_object() noexcept { return { std::coroutine_handle<promise_type>::from_promise(*this) }; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+    ~owned_task()
+    {
+        handle.destroy();
+    }
+    std::coroutine_handle<promise_type> handle;
+};
+template <typename... Executor> detached_task awaitString(uc::jni::global_ref<jobject> future, std::promise<std::string>& result, Executor&... executor)
+{
+    try {
+        auto value = co_await uc::jni::awaitable<std::string>(future, executor...);
+        result.set_value(value + " on " + std::to_string(uc::jni::env() != nullptr));
+    } catch (...) {
+        result.set_exception(std::current_exception());
+    }
+}
+owned_task awaitForever(uc::jni::global_ref<jobject> future, bool& resumed)
+{
+    co_await uc::jni::awaitable<std::string>(future);
+    resumed = true;
+}
+JNI(void, testAwaitCompletion)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        TEST_ASSERT(uc::jni::register_completion_callback<NativeCompletion>());
+        auto supplyLater = uc::jni::make_method<UcJniTest, jobject(std::string)>("supplyLater");
+        auto failLater = uc::jni::make_method<UcJniTest, jobject(std::string)>("failLater");
+        {
+            std::promise<std::string> result;
+            awaitString(uc::jni::make_global(supplyLater(thiz, "Hello")), result);
+            TEST_ASSERT_EQUALS(std::string("Hello on 1"), result.get_future().get());
+        }
+        {
+            uc::jni::thread_pool pool(1, "uc-jni-resume");
+            std::promise<std::string> result;
+            awaitString(uc::jni::make_global(supplyLater(thiz, "World")), result, pool);
+            TEST_ASSERT_EQUALS(std::string("World on 1"), result.get_future().get());
+        }
+        {
+            std::promise<std::string> result;
+            awaitString(uc::jni::make_global(failLater(thiz, "failed")), result);
+            try {
+                result.get_future().get();
+                TEST_ASSERT(false);
+            } catch (uc::jni::vm_exception& e) {
+                TEST_ASSERT(uc::jni::is_instance_of<IllegalStateException>(e.throwable));
+                TEST_ASSERT_EQUALS(std::string("failed"), std::string(e.what()));
+            }
+        }
+        {
+            // the coroutine is destroyed while suspended; completing the stage afterwards resumes nothing.
+            static auto newFuture = uc::jni::make_constructor<CompletableFuture()>();
+            static auto complete = uc::jni::make_method<CompletableFuture, bool(jobject)>("complete");
+            auto future = uc::jni::make_global(newFuture());
+            bool resumed = false;
+            {
+                auto task = awaitForever(uc::jni::make_global<jobject>(future.get()), resumed);
+                TEST_ASSERT(!task.handle.done());
+            }
+            TEST_ASSERT(complete(future, uc::jni::to_jstring("late")));
+            TEST_ASSERT(!resumed);
+        }
+    });
+}
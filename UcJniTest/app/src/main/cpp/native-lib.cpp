@@ -1,4 +1,16 @@
 #define UC_JNI_BETA_VERSION
+#define UC_JNI_ENABLE_METRICS
+#define UC_JNI_ENABLE_TRACE
+#define UC_JNI_ENABLE_REF_STATS
+#define UC_JNI_ENABLE_COPY_STATS
+#define UC_JNI_ENABLE_ALLOC_AUDIT
+#define UC_JNI_ENABLE_THREAD_POOL
+#define UC_JNI_ENABLE_UPCALL_CHANNEL
+#define UC_JNI_ENABLE_RING_BUFFER
+#define UC_JNI_ENABLE_HANDLE_TABLE
+#define UC_JNI_ENABLE_PEER_REGISTRY
+#define UC_JNI_ENABLE_IDENTITY_LOCKS
+#define UC_JNI_ENABLE_IDENTITY_MAP
 #include "androidlog.hpp"
 #include "../../../../../uc-jni.hpp"
 #include <string>
@@ -6,6 +18,8 @@
 #include <stdexcept>
 #include <algorithm>
 #include <future>
+#include <numeric>
+#include <sstream>
 
 #define TO_STRING_(n)	#n
 #define TO_STRING(n)	TO_STRING_(n)
@@ -22,6 +36,8 @@
 #define STATIC_ASSERT_EQUALS(expected, actual) STATIC_ASSERT(expected == actual)
 #define STATIC_ASSERT_NOT_EQUALS(unexpected, actual) STATIC_ASSERT(unexpected != actual)
 
+UC_JNI_DEFINE_ALLOC_AUDIT_OPERATOR_NEW()
+
 
 //*************************************************************************************************
 // Class FQCN
@@ -131,12 +147,18 @@ UC_JNI_DEFINE_JCLASS(UcJniTest, com/example/uc/ucjnitest/UcJniTest)
 //*************************************************************************************************
 // Test sizeof
 //*************************************************************************************************
-STATIC_ASSERT_EQUALS(sizeof(uc::jni::field<System, int>), sizeof(jfieldID));
-STATIC_ASSERT_EQUALS(sizeof(uc::jni::static_field<System, int>), sizeof(jfieldID));
-STATIC_ASSERT_EQUALS(sizeof(uc::jni::method<System, void()>), sizeof(jmethodID));
-STATIC_ASSERT_EQUALS(sizeof(uc::jni::non_virtual_method<System, void()>), sizeof(jmethodID));
-STATIC_ASSERT_EQUALS(sizeof(uc::jni::static_method<System, void()>), sizeof(jmethodID));
-STATIC_ASSERT_EQUALS(sizeof(uc::jni::constructor<UcJniTest()>), sizeof(jmethodID));
+// with UC_JNI_ENABLE_METRICS, accessors also hold their call site id.
+#ifdef UC_JNI_ENABLE_METRICS
+constexpr size_t call_site_size = sizeof(uc::jni::metrics::call_site_id);
+#else
+constexpr size_t call_site_size = 0;
+#endif
+STATIC_ASSERT_EQUALS(sizeof(uc::jni::field<System, int>), sizeof(jfieldID) + call_site_size);
+STATIC_ASSERT_EQUALS(sizeof(uc::jni::static_field<System, int>), sizeof(jfieldID) + call_site_size);
+STATIC_ASSERT_EQUALS(sizeof(uc::jni::method<System, void()>), sizeof(jmethodID) + call_site_size);
+STATIC_ASSERT_EQUALS(sizeof(uc::jni::non_virtual_method<System, void()>), sizeof(jmethodID) + call_site_size);
+STATIC_ASSERT_EQUALS(sizeof(uc::jni::static_method<System, void()>), sizeof(jmethodID) + call_site_size);
+STATIC_ASSERT_EQUALS(sizeof(uc::jni::constructor<UcJniTest()>), sizeof(jmethodID) + call_site_size);
 
 //*************************************************************************************************
 // Static Variables
@@ -251,9 +273,9 @@ JNI(void, samplePoint)(JNIEnv *env, jobject thiz)
         auto offset = uc::jni::make_method<Point, void(int,int)>("offset");
 
         // Accessors do not use any extra memory.
-        TEST_ASSERT_EQUALS(sizeof(newPoint), sizeof(jmethodID));
-        TEST_ASSERT_EQUALS(sizeof(x), sizeof(jfieldID));
-        TEST_ASSERT_EQUALS(sizeof(offset), sizeof(jmethodID));
+        TEST_ASSERT_EQUALS(sizeof(newPoint), sizeof(jmethodID) + call_site_size);
+        TEST_ASSERT_EQUALS(sizeof(x), sizeof(jfieldID) + call_site_size);
+        TEST_ASSERT_EQUALS(sizeof(offset), sizeof(jmethodID) + call_site_size);
 
 
         auto p0 = newPoint(12, 34);
@@ -362,6 +384,15 @@ JNI(void, testResolveClass)(JNIEnv *env, jobject thiz)
             LOGD << "## FindClass()+unordered_map  : " << duration_cast<microseconds>(end - start).count() << "us";
         }
 
+        {
+            auto start = clock_type::now();
+            for (size_t i = 0; i < loopCount; ++i) {
+                uc::jni::find_class("android/graphics/Point");
+            }
+            auto end = clock_type::now();
+            LOGD << "## uc::jni::find_class()  : " << duration_cast<microseconds>(end - start).count() << "us";
+        }
+
         {
             auto start = clock_type::now();
             for (size_t i = 0; i < loopCount; ++i) {
@@ -1094,7 +1125,7 @@ JNI(void, testObjectElements)(JNIEnv *env, jobject thiz)
         }
 
         {
-            uc::jni::set_region(array, 0, 4, values2.begin(), [](auto&& str) { return uc::jni::to_jstring(str).release(); });
+            uc::jni::set_region(array, 0, 4, values2.begin(), [](auto&& str) { return uc::jni::release_local(uc::jni::to_jstring(str)); });
 
             std::vector<std::string> values3(4);
             uc::jni::get_region(array, 0, 4, values3.begin(), [](auto&& str) { return uc::jni::to_string(str); });
@@ -1201,8 +1232,8 @@ jboolean returnTrue(JNIEnv* env, jobject obj)
 }
 jstring returnString(JNIEnv* env, jobject obj, jstring str)
 {
-    // return uc::jni::to_jstring("[" + uc::jni::to_string(str) + "] received.").release();
-    return uc::jni::join("[", str, "] received.").release();
+    // return uc::jni::release_local(uc::jni::to_jstring("[" + uc::jni::to_string(str) + "] received."));
+    return uc::jni::release_local(uc::jni::join("[", str, "] received."));
 }
 jint plus(JNIEnv* env, jobject obj, jint i, jint j)
 {
@@ -1312,8 +1343,8 @@ template <> struct type_traits<std::deque<std::string>>
     {
         const auto len = static_cast<jsize>(v.size());
         auto ret = new_array<jstring>(len);
-        set_region(ret, 0, len, v.begin(), [](auto&& value) { return to_jstring(value).release(); });
-        return ret.release(); 
+        set_region(ret, 0, len, v.begin(), [](auto&& value) { return release_local(to_jstring(value)); });
+        return release_local(ret);
     }
 };
 
@@ -1356,7 +1387,7 @@ template <> struct type_traits<std::map<std::string, int>>
         for (auto&& v : value) {
             put(ret, to_jstring(v.first), newInteger(v.second));
         }
-        return ret.release(); 
+        return release_local(ret);
     }
 };
 
@@ -1394,4 +1425,1150 @@ JNI(void, testCustomTraits2)(JNIEnv *env, jobject thiz)
         map.emplace("international", 13);
         putHashMap(thiz, map);
     });
-}
\ No newline at end of file
+}
+
+//*************************************************************************************************
+// Call Site Metrics
+//*************************************************************************************************
+JNI(void, testMetrics)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        auto getFieldInt = uc::jni::make_method<UcJniTest, jint()>("getFieldInt");
+        auto getStaticFieldInt = uc::jni::make_static_method<UcJniTest, jint()>("getStaticFieldInt");
+        auto fieldInt = uc::jni::make_field<UcJniTest, jint>("fieldInt");
+
+        // the same FQCN, name and signature share one call site.
+        TEST_ASSERT_EQUALS(getFieldInt.site, (uc::jni::make_method<UcJniTest, jint()>("getFieldInt").site));
+        TEST_ASSERT_NOT_EQUALS(getFieldInt.site, (uc::jni::make_non_virtual_method<UcJniTest, jint()>("getFieldInt").site));
+
+        auto find = [](const std::vector<uc::jni::metrics::call_site_stats>& stats, const char* kind, const char* name) {
+            auto found = std::find_if(stats.begin(), stats.end(), [&](auto&& s) { return s.kind == kind && s.name == name; });
+            if (found == stats.end()) throw std::runtime_error(std::string("call site not found : ") + name);
+            return *found;
+        };
+
+        uc::jni::metrics::reset();
+        for (int i = 0; i < 10; ++i) {
+            getFieldInt(thiz);
+        }
+        fieldInt.set(thiz, fieldInt.get(thiz));
+        // counts of exited threads remain.
+        std::thread([&] {
+            for (int i = 0; i < 5; ++i) {
+                getStaticFieldInt();
+            }
+        }).join();
+
+        auto stats = uc::jni::metrics::snapshot();
+        auto m = find(stats, "method", "getFieldInt");
+        TEST_ASSERT_EQUALS(std::string("com/example/uc/ucjnitest/UcJniTest"), m.class_name);
+        TEST_ASSERT_EQUALS(std::string("()I"), m.signature);
+        TEST_ASSERT_EQUALS(10, m.calls);
+        TEST_ASSERT_EQUALS(10, std::accumulate(m.histogram.begin(), m.histogram.end(), uint64_t{}));
+        TEST_ASSERT_EQUALS(2, find(stats, "field", "fieldInt").calls);
+        TEST_ASSERT_EQUALS(5, find(stats, "static_method", "getStaticFieldInt").calls);
+
+        uc::jni::metrics::reset();
+        stats = uc::jni::metrics::snapshot();
+        TEST_ASSERT_EQUALS(0, find(stats, "method", "getFieldInt").calls);
+        TEST_ASSERT_EQUALS(0, find(stats, "static_method", "getStaticFieldInt").calls);
+    });
+}
+
+//*************************************************************************************************
+// Tracing
+//*************************************************************************************************
+JNI(void, testTrace)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        uc::jni::trace::clear();
+        uc::jni::trace::set_thread_name("testTrace");
+
+        uc::jni::exception_guard([&] {
+            auto p = jPoint_::new_(3.0, 4.0);
+            TEST_ASSERT_EQUALS(5.0, p->norm());
+            const std::vector<jint> values { 1, 2, 3 };
+            TEST_ASSERT_EQUALS(values, uc::jni::to_vector(uc::jni::to_jarray(values)));
+            TEST_ASSERT_EQUALS(std::string("abc"), uc::jni::to_string(uc::jni::join("a", "b", "c")));
+        });
+        std::thread([] {
+            uc::jni::trace::scope s("worker", "user");
+        }).join();
+        std::thread([] {
+            uc::jni::trace::set_thread_name("tab\t\"quoted\"\n");
+            uc::jni::trace::scope s("escaped", "user");
+        }).join();
+
+        std::ostringstream os;
+        uc::jni::trace::write_json(os);
+        const auto json = os.str();
+        auto contains = [&](const char* str) { return json.find(str) != std::string::npos; };
+        TEST_ASSERT(contains("\"traceEvents\""));
+        TEST_ASSERT(contains("{\"name\": \"thread_name\", \"ph\": \"M\""));
+        TEST_ASSERT(contains("{\"name\": \"exception_guard\", \"cat\": \"jni\", \"ph\": \"X\""));
+        TEST_ASSERT(contains("{\"name\": \"<init>\", \"cat\": \"upcall\""));
+        TEST_ASSERT(contains("{\"name\": \"norm\", \"cat\": \"upcall\""));
+        TEST_ASSERT(contains("\"args\": {\"detail\": \"com/example/uc/ucjnitest/Point\"}"));
+        TEST_ASSERT(contains("{\"name\": \"to_jarray\", \"cat\": \"convert\""));
+        TEST_ASSERT(contains("{\"name\": \"to_vector\", \"cat\": \"convert\""));
+        TEST_ASSERT(contains("{\"name\": \"join\", \"cat\": \"convert\""));
+        TEST_ASSERT(contains("{\"name\": \"to_basic_string\", \"cat\": \"convert\""));
+        TEST_ASSERT(contains("{\"name\": \"worker\", \"cat\": \"user\""));
+        TEST_ASSERT(contains("\"tab\\u0009\\\"quoted\\\"\\u000a\""));
+
+        uc::jni::trace::clear();
+        os.str("");
+        uc::jni::trace::write_json(os);
+        TEST_ASSERT(os.str().find("\"worker\"") == std::string::npos);
+    });
+}
+
+//*************************************************************************************************
+// Reference Statistics
+//*************************************************************************************************
+JNI(void, testRefStats)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        const auto before = uc::jni::ref_stats::local();
+        uc::jni::ref_stats::reset_local_peak();
+        {
+            auto s1 = uc::jni::to_jstring("Hello");
+            auto s2 = uc::jni::to_jstring("World");
+            auto s3 = uc::jni::make_local(s1.get());
+            TEST_ASSERT_EQUALS(before.current + 3, uc::jni::ref_stats::local().current);
+        }
+        const auto after = uc::jni::ref_stats::local();
+        TEST_ASSERT_EQUALS(before.current, after.current);
+        TEST_ASSERT_EQUALS(before.current + 3, after.peak);
+        TEST_ASSERT_EQUALS(before.adopted + 3, after.adopted);
+        TEST_ASSERT_EQUALS(before.deleted + 3, after.deleted);
+
+        // a reference handed back to the caller is no longer owned.
+        {
+            auto s = uc::jni::to_jstring("returned");
+            const auto raw = uc::jni::release_local(s);
+            TEST_ASSERT_EQUALS(after.current, uc::jni::ref_stats::local().current);
+            TEST_ASSERT_EQUALS(after.deleted + 1, uc::jni::ref_stats::local().deleted);
+            env->DeleteLocalRef(raw);
+        }
+
+        auto point = [] {
+            auto all = uc::jni::ref_stats::globals();
+            auto found = std::find_if(all.begin(), all.end(), [](auto&& s) { return s.type.find("jPoint_") != std::string::npos; });
+            return found == all.end() ? uc::jni::ref_stats::global_stats{} : *found;
+        };
+        const auto pointBefore = point();
+        {
+            auto g = uc::jni::make_global(jPoint_::new_(1.0, 2.0));
+            auto g2 = g;
+            uc::jni::weak_ref<jPoint> w(g);
+            TEST_ASSERT_EQUALS(pointBefore.live_global + 1, point().live_global);
+            TEST_ASSERT_EQUALS(pointBefore.live_weak + 1, point().live_weak);
+        }
+        TEST_ASSERT_EQUALS(pointBefore.live_global, point().live_global);
+        TEST_ASSERT_EQUALS(pointBefore.live_weak, point().live_weak);
+
+        std::ostringstream os;
+        uc::jni::ref_stats::dump(os);
+        TEST_ASSERT(os.str().find("jPoint_") != std::string::npos);
+    });
+}
+
+//*************************************************************************************************
+// Copy Statistics
+//*************************************************************************************************
+JNI(void, testCopyStats)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        auto find = [](const char* operation, const char* element, const char* direction) {
+            auto all = uc::jni::copy_stats::snapshot();
+            auto found = std::find_if(all.begin(), all.end(), [&](auto&& e) { return e.operation == operation && e.element == element && e.direction == direction; });
+            if (found == all.end()) throw std::runtime_error(std::string("entry not found : ") + operation);
+            return *found;
+        };
+
+        uc::jni::copy_stats::reset();
+        TEST_ASSERT(uc::jni::copy_stats::snapshot().empty());
+
+        const std::vector<jint> values { 1, 2, 3 };
+        auto array = uc::jni::to_jarray(values);
+        TEST_ASSERT_EQUALS(values, uc::jni::to_vector(array));
+        TEST_ASSERT_EQUALS(std::string("Hello"), uc::jni::to_string(uc::jni::to_jstring("Hello")));
+        {
+            jboolean isCopy = JNI_FALSE;
+            auto elems = uc::jni::get_const_elements(array, &isCopy);
+            auto e = find("get_elements", "int", "to_native");
+            TEST_ASSERT_EQUALS(1, e.calls);
+            TEST_ASSERT_EQUALS(12, e.bytes);
+            TEST_ASSERT_EQUALS((isCopy == JNI_TRUE ? 1 : 0), e.copies);
+        }
+        {
+            auto str = uc::jni::to_jstring("World");
+            jboolean isCopy = JNI_FALSE;
+            auto chars = uc::jni::get_chars<char>(str.get(), &isCopy);
+            auto e = find("get_chars", "utf8", "to_native");
+            TEST_ASSERT_EQUALS(1, e.calls);
+            TEST_ASSERT_EQUALS(5, e.bytes);
+            TEST_ASSERT_EQUALS((isCopy == JNI_TRUE ? 1 : 0), e.copies);
+        }
+        char buf[64];
+        auto buffer = uc::jni::new_direct_byte_buffer(buf, sizeof(buf));
+        auto intBuffer = uc::jni::new_direct_buffer<int32_t>(16);
+
+        auto e = find("to_jarray", "int", "to_java");
+        TEST_ASSERT_EQUALS(1, e.calls);
+        TEST_ASSERT_EQUALS(3, e.elements);
+        TEST_ASSERT_EQUALS(12, e.bytes);
+        TEST_ASSERT_EQUALS(12, find("to_vector", "int", "to_native").bytes);
+        TEST_ASSERT_EQUALS(10, find("to_jstring", "utf8", "to_java").bytes);
+        TEST_ASSERT_EQUALS(5, find("to_basic_string", "utf8", "to_native").bytes);
+        e = find("direct_buffer", "byte", "to_java");
+        TEST_ASSERT_EQUALS(2, e.calls);
+        TEST_ASSERT_EQUALS(64 + 16 * 4, e.bytes);
+        TEST_ASSERT_EQUALS(0, e.copies);
+    });
+}
+
+//*************************************************************************************************
+// Allocation Budgets
+//*************************************************************************************************
+JNI(void, testAllocationBudgets)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        auto getFieldInt = uc::jni::make_method<UcJniTest, jint()>("getFieldInt");
+        auto getStaticFieldInt = uc::jni::make_static_method<UcJniTest, jint()>("getStaticFieldInt");
+        auto fieldInt = uc::jni::make_field<UcJniTest, jint>("fieldInt");
+        const auto str = uc::jni::to_jstring("Hello");
+        const auto intArray = uc::jni::to_jarray(std::vector<jint>{ 1, 2, 3 });
+        const auto global = uc::jni::make_global(thiz);
+        uc::jni::object_pool<jPoint> points([] { return jPoint_::new_(0.0, 0.0); }, [](jPoint p) { p->x(0.0).y(0.0); }, 4, 1);
+
+        // the first call creates statics and per-thread state (metrics, trace, ref stats), so it is not counted.
+        auto budget = [](const char* operation, uint64_t maxAllocations, auto&& func) {
+            func();
+            const auto n = uc::jni::alloc_audit::count(func);
+            if (n > maxAllocations) {
+                throw std::runtime_error(std::string(operation) + " : " + std::to_string(n) + " allocations (budget " + std::to_string(maxAllocations) + ")");
+            }
+        };
+        budget("primitive method call", 0, [&] { getFieldInt(thiz); });
+        budget("primitive static method call", 0, [&] { getStaticFieldInt(); });
+        budget("primitive field get/set", 0, [&] { fieldInt.set(thiz, fieldInt.get(thiz)); });
+        budget("macro method call", 0, [&] { static_cast<UcJniTest>(thiz)->getFieldInt(); });
+        budget("get_class", 0, [&] { uc::jni::get_class<UcJniTest>(); });
+        budget("find_class", 0, [&] { uc::jni::find_class("java/lang/String"); });
+        budget("make_local", 0, [&] { uc::jni::make_local(thiz); });
+        budget("exception_check", 0, [&] { uc::jni::exception_check(); });
+        budget("to_jstring", 0, [&] { uc::jni::to_jstring("Hello"); });
+        budget("to_string (short string)", 0, [&] { uc::jni::to_string(str); });
+        budget("global_ref copy", 0, [&] { auto copy = global; });
+        budget("make_global", 1, [&] { uc::jni::make_global(thiz); });          // shared_ptr control block
+        budget("weak_ref", 1, [&] { uc::jni::weak_ref<jobject> w(thiz); });     // shared_ptr control block
+        budget("make_unique_global", 0, [&] { uc::jni::make_unique_global(thiz); });
+        budget("unique_weak_ref", 0, [&] { uc::jni::unique_weak_ref<jobject> w(thiz); });
+        budget("object_pool acquire/recycle", 0, [&] { points.acquire()->x(1.0); });
+        budget("to_vector<jint>", 1, [&] { uc::jni::to_vector(intArray); });
+        budget("join", 2, [&] { uc::jni::join("Hello", " ", "World"); });
+
+        TEST_ASSERT_EQUALS(1, uc::jni::alloc_audit::count([] { delete new int(0); }));
+#ifdef __cpp_aligned_new
+        struct alignas(64) line { char bytes[64]; };
+        TEST_ASSERT_EQUALS(2, uc::jni::alloc_audit::count([] { delete new line; delete[] new line[4]; }));
+#endif
+    });
+}
+
+//*************************************************************************************************
+// Explicit JNIEnv
+//*************************************************************************************************
+JNI(void, testExplicitEnv)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        auto getFieldInt = uc::jni::make_method<UcJniTest, jint()>("getFieldInt");
+        auto getStaticFieldInt = uc::jni::make_static_method<UcJniTest, jint()>("getStaticFieldInt");
+        auto getFieldString = uc::jni::make_method<UcJniTest, std::string()>("getFieldString");
+        auto fieldInt = uc::jni::make_field<UcJniTest, jint>("fieldInt");
+        auto staticFieldInt = uc::jni::make_static_field<UcJniTest, jint>("staticFieldInt");
+        auto newPoint = uc::jni::make_constructor<jPoint(jdouble, jdouble)>();
+        auto x = uc::jni::make_field<jPoint, jdouble>("x");
+
+        fieldInt.set(env, thiz, 123);
+        TEST_ASSERT_EQUALS(123, fieldInt.get(env, thiz));
+        TEST_ASSERT_EQUALS(123, getFieldInt.call(env, thiz));
+        TEST_ASSERT_EQUALS(getFieldString(thiz), getFieldString.call(env, thiz));
+        staticFieldInt.set(env, 456);
+        TEST_ASSERT_EQUALS(456, staticFieldInt.get(env));
+        TEST_ASSERT_EQUALS(456, getStaticFieldInt.call(env));
+
+        auto p = newPoint.call(env, 1.5, 2.0);
+        TEST_ASSERT_EQUALS(1.5, x.get(env, p));
+        // the explicit overloads return local_ref_in, which keeps env; local_ref stays one pointer.
+        STATIC_ASSERT((std::is_same<uc::jni::local_ref_in<jPoint>, decltype(p)>::value));
+        STATIC_ASSERT(sizeof(uc::jni::local_ref<jPoint>) == sizeof(jPoint));
+        STATIC_ASSERT((std::is_same<uc::jni::local_ref<jPoint>, decltype(newPoint(1.5, 2.0))>::value));
+
+        auto ints = uc::jni::new_array<jint>(env, 4);
+        TEST_ASSERT_EQUALS(4, uc::jni::length(env, ints));
+        const jint src[] = { 1, 2, 3, 4 };
+        uc::jni::set_region(env, ints, 0, 4, src);
+        jint dst[4] = {};
+        uc::jni::get_region(env, ints, 0, 4, dst);
+        TEST_ASSERT(std::equal(std::begin(src), std::end(src), std::begin(dst)));
+        {
+            auto elems = uc::jni::get_elements(env, ints);
+            uc::jni::begin(elems)[0] = 10;
+        }
+        TEST_ASSERT_EQUALS(10, uc::jni::to_vector(ints)[0]);
+        {
+            const auto elems = uc::jni::get_const_elements(env, ints);
+            TEST_ASSERT_EQUALS(19, std::accumulate(uc::jni::begin(elems), uc::jni::end(elems), 0));
+        }
+
+        auto strs = uc::jni::new_array<jstring>(env, 2);
+        uc::jni::set(env, strs, 1, uc::jni::to_jstring("World"));
+        TEST_ASSERT(!uc::jni::get(env, strs, 0));
+        TEST_ASSERT_EQUALS("World", uc::jni::to_string(uc::jni::get(env, strs, 1)));
+
+        // a hot loop that never touches thread local storage.
+        jint sum = 0;
+        for (int i = 0; i < 100; ++i) {
+            sum += getFieldInt.call(env, thiz);
+        }
+        TEST_ASSERT_EQUALS(12300, sum);
+        uc::jni::exception_check(env);
+    });
+}
+
+//*************************************************************************************************
+// Env Acquisition
+//*************************************************************************************************
+UC_JNI_DEFINE_JCLASS_ALIAS(Thread, java/lang/Thread);
+JNI(void, testEnvAcquisition)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::env_scope scope(env);
+    uc::jni::exception_guard([&] {
+        auto currentThread = uc::jni::make_static_method<Thread, Thread()>("currentThread");
+        auto getName = uc::jni::make_method<Thread, std::string()>("getName");
+        auto isDaemon = uc::jni::make_method<Thread, jboolean()>("isDaemon");
+
+        // a Java thread is never detached by uc-jni.
+        TEST_ASSERT_EQUALS(env, uc::jni::env());
+        TEST_ASSERT(!uc::jni::detach_current_thread());
+        TEST_ASSERT_EQUALS(env, uc::jni::env());
+
+        std::string name;
+        jboolean daemon = JNI_FALSE;
+        bool sameEnv = false;
+        bool detached = false;
+        std::thread([&] {
+            auto e = uc::jni::attach_current_thread("uc-jni-worker", true);
+            sameEnv = (e == uc::jni::env() && e == uc::jni::attach_current_thread("ignored"));
+            uc::jni::exception_guard([&] {
+                auto self = currentThread();
+                name = getName(self);
+                daemon = isDaemon(self);
+            });
+            detached = uc::jni::detach_current_thread();
+        }).join();
+        TEST_ASSERT(sameEnv);
+        TEST_ASSERT_EQUALS(std::string("uc-jni-worker"), name);
+        TEST_ASSERT_EQUALS(JNI_TRUE, daemon);
+        TEST_ASSERT(detached);
+
+        // env() attaches an unknown thread on first use and detaches it at thread exit.
+        daemon = JNI_TRUE;
+        std::thread([&] {
+            uc::jni::exception_guard([&] {
+                daemon = isDaemon(currentThread());
+            });
+        }).join();
+        TEST_ASSERT_EQUALS(JNI_FALSE, daemon);
+
+        // a thread attached by someone else may be detached and re-attached; env() never returns the old JNIEnv*.
+        bool reattached = false;
+        std::thread([&] {
+            const auto vm = uc::jni::java_vm();
+            JNIEnv* e{};
+            vm->AttachCurrentThread(uc::jni::internal::env_out{ &e }, nullptr);
+            const bool first = (e == uc::jni::env());
+            vm->DetachCurrentThread();
+            vm->AttachCurrentThread(uc::jni::internal::env_out{ &e }, nullptr);
+            reattached = first && (e == uc::jni::env()) && !uc::jni::detach_current_thread();
+            {
+                // an env_scope caches the pointer only while it lives.
+                uc::jni::env_scope scope(e);
+                reattached = reattached && (e == uc::jni::env());
+            }
+            vm->DetachCurrentThread();
+            vm->AttachCurrentThread(uc::jni::internal::env_out{ &e }, nullptr);
+            reattached = reattached && (e == uc::jni::env());
+            vm->DetachCurrentThread();
+        }).join();
+        TEST_ASSERT(reattached);
+    });
+}
+
+//*************************************************************************************************
+// Thread Pool
+//*************************************************************************************************
+UC_JNI_DEFINE_JCLASS_ALIAS(NumberFormatException, java/lang/NumberFormatException);
+JNI(void, testThreadPool)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        uc::jni::thread_pool pool(4, "uc-jni-test");
+        TEST_ASSERT_EQUALS(4, pool.size());
+
+        auto getName = uc::jni::make_method<Thread, std::string()>("getName");
+        auto isDaemon = uc::jni::make_method<Thread, jboolean()>("isDaemon");
+        auto currentThread = uc::jni::make_static_method<Thread, Thread()>("currentThread");
+        auto name = pool.submit([&] { return getName(currentThread()); }).get();
+        TEST_ASSERT_EQUALS(0u, name.find("uc-jni-test-"));
+        TEST_ASSERT_EQUALS(JNI_TRUE, pool.submit([&] { return isDaemon(currentThread()); }).get());
+
+        // every task runs in its own local frame, so local references never pile up.
+        std::vector<std::future<double>> results;
+        for (int i = 0; i < 1000; ++i) {
+            results.push_back(pool.submit([](double x, double y) { return jPoint_::new_(x, y)->norm(); }, 3.0 * i, 4.0 * i));
+        }
+        for (int i = 0; i < 1000; ++i) {
+            TEST_ASSERT_EQUALS(5.0 * i, results[i].get());
+        }
+
+        // tasks submitted from a worker go to its own queue and are stolen by idle workers.
+        auto sum = pool.submit([&pool] {
+            std::vector<std::future<int>> nested;
+            for (int i = 1; i <= 100; ++i) {
+                nested.push_back(pool.submit([i] { return i; }));
+            }
+            int ret = 0;
+            for (auto&& f : nested) ret += f.get();
+            return ret;
+        });
+        TEST_ASSERT_EQUALS(5050, sum.get());
+
+        // a Java exception comes back as uc::jni::vm_exception.
+        auto parseInt = uc::jni::make_static_method<Integer, jint(std::string)>("parseInt");
+        auto failed = pool.submit([&] { return parseInt("not a number"); });
+        try {
+            failed.get();
+            TEST_ASSERT(false);
+        } catch (uc::jni::vm_exception& e) {
+            TEST_ASSERT(uc::jni::is_instance_of<NumberFormatException>(e.throwable));
+        }
+        // a pending exception left by raw JNI calls is reported too.
+        auto pending = pool.submit([] { uc::jni::throw_new<NumberFormatException>("pending"); });
+        try {
+            pending.get();
+            TEST_ASSERT(false);
+        } catch (uc::jni::vm_exception& e) {
+            TEST_ASSERT_EQUALS(std::string("pending"), std::string(e.what()));
+        }
+    });
+}
+
+// Coroutine Support : coroutine-test.cpp (C++20)
+
+//*************************************************************************************************
+// Asynchronous Completion
+//*************************************************************************************************
+uc::jni::thread_pool& asyncPool()
+{
+    static uc::jni::thread_pool pool(2, "uc-jni-async");
+    return pool;
+}
+JNI(jobject, concatAsync)(JNIEnv *env, jobject thiz, jstring a, jstring b)
+{
+    return uc::jni::exception_guard([&] {
+        return uc::jni::release_local(uc::jni::async([a = uc::jni::to_string(a), b = uc::jni::to_string(b)] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            return a + ", " + b;
+        }));
+    });
+}
+JNI(jobject, sumAsync)(JNIEnv *env, jobject thiz, jint a, jint b)
+{
+    return uc::jni::exception_guard([&] {
+        return uc::jni::release_local(uc::jni::async(asyncPool(), [a, b] { return a + b; }));
+    });
+}
+JNI(jobject, parseAsync)(JNIEnv *env, jobject thiz, jstring str)
+{
+    return uc::jni::exception_guard([&] {
+        return uc::jni::release_local(uc::jni::async(asyncPool(), [str = uc::jni::make_global(str)] {
+            static auto parseInt = uc::jni::make_static_method<Integer, jint(jstring)>("parseInt");
+            return parseInt(str);
+        }));
+    });
+}
+JNI(jobject, failAsync)(JNIEnv *env, jobject thiz, jstring message)
+{
+    return uc::jni::exception_guard([&] {
+        return uc::jni::release_local(uc::jni::async([message = uc::jni::to_string(message)] {
+            throw std::runtime_error(message);
+        }));
+    });
+}
+
+//*************************************************************************************************
+// Upcall Channel
+//*************************************************************************************************
+JNI(void, testUpcallChannel)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        auto onEvents = uc::jni::make_static_method<UcJniTest, void(jint, jintArray, jlongArray, uc::jni::array<jstring>)>("onEvents");
+        auto eventCount = uc::jni::make_static_field<UcJniTest, jint>("eventCount");
+        auto eventBatches = uc::jni::make_static_field<UcJniTest, jint>("eventBatches");
+        auto eventSum = uc::jni::make_static_field<UcJniTest, jlong>("eventSum");
+        auto lastEvent = uc::jni::make_static_field<UcJniTest, std::string>("lastEvent");
+
+        uc::jni::upcall_channel<jint, jlong, std::string> channel([&](jint count, const auto& ids, const auto& values, const auto& messages) {
+            onEvents(count, ids, values, messages);
+        }, 256, std::chrono::milliseconds(5));
+
+        std::vector<std::thread> producers;
+        for (int t = 0; t < 4; ++t) {
+            producers.emplace_back([&channel] {
+                for (int i = 0; i < 1000; ++i) {
+                    channel.post(1, static_cast<jlong>(i), "event");
+                }
+            });
+        }
+        for (auto&& t : producers) t.join();
+        channel.flush();
+        TEST_ASSERT_EQUALS(4000, eventCount.get());
+        TEST_ASSERT_EQUALS(4 * (1000 + 999 * 1000 / 2), eventSum.get());
+        TEST_ASSERT(eventBatches.get() >= 4000 / 256);
+        TEST_ASSERT(eventBatches.get() < 4000);
+
+        channel.post(0, 0, "last");
+        channel.flush();
+        TEST_ASSERT_EQUALS(4001, eventCount.get());
+        TEST_ASSERT_EQUALS(std::string("last"), lastEvent.get());
+
+        // a full batch is delivered at once, without waiting for maxLatency.
+        std::atomic<int> delivered { 0 };
+        uc::jni::upcall_channel<jint> batched([&](jint count, const auto&) { delivered += count; }, 8, std::chrono::seconds(10));
+        const auto start = std::chrono::steady_clock::now();
+        for (int round = 1; round <= 100; ++round) {
+            for (int i = 0; i < 8; ++i) batched.post(i);
+            while (delivered < round * 8) std::this_thread::yield();
+        }
+        TEST_ASSERT(std::chrono::steady_clock::now() - start < std::chrono::seconds(10));
+    });
+}
+
+//*************************************************************************************************
+// Ring Buffer
+//*************************************************************************************************
+JNI(void, testRingBuffer)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        uc::jni::spsc_ring ring(1024);
+        TEST_ASSERT_EQUALS(1024, ring.capacity());
+        TEST_ASSERT_EQUALS(uc::jni::spsc_ring::data_offset + 1024, static_cast<size_t>(env->GetDirectBufferCapacity(ring.buffer())));
+        TEST_ASSERT(!ring.try_read([](const void*, size_t) {}));
+
+        // variable-length records wrap around the data area many times.
+        constexpr int count = 10000;
+        std::thread producer([&ring] {
+            for (int i = 0; i < count; ++i) {
+                const auto str = std::to_string(i) + std::string(i % 100, '.');
+                ring.write(str.data(), str.size());
+            }
+        });
+        int received = 0;
+        int mismatches = 0;
+        for (int i = 0; i < count; ++i) {
+            ring.read([&](const void* data, size_t size) {
+                if (std::string(static_cast<const char*>(data), size) != std::to_string(i) + std::string(i % 100, '.')) ++mismatches;
+                ++received;
+            });
+        }
+        producer.join();
+        TEST_ASSERT_EQUALS(count, received);
+        TEST_ASSERT_EQUALS(0, mismatches);
+
+        // the same ByteBuffer seen through a second ring; in-place writes.
+        uc::jni::spsc_ring view(ring.buffer());
+        TEST_ASSERT(ring.try_write(sizeof(jint), [](void* p) { *static_cast<jint*>(p) = 42; }));
+        jint value = 0;
+        TEST_ASSERT(view.try_read([&](const void* p, size_t size) { TEST_ASSERT_EQUALS(sizeof(jint), size); value = *static_cast<const jint*>(p); }));
+        TEST_ASSERT_EQUALS(42, value);
+
+        // full ring: 12-byte records occupy 16 bytes.
+        const std::string record(12, 'x');
+        int written = 0;
+        while (ring.try_write(record.data(), record.size())) ++written;
+        TEST_ASSERT(written >= 1024 / 16 - 1);
+        TEST_ASSERT(view.try_read([](const void*, size_t) {}));
+        TEST_ASSERT(view.try_read([](const void*, size_t) {}));
+        TEST_ASSERT(ring.try_write(record.data(), record.size()));
+        const std::string oversized(ring.max_size() + 1, 'o');
+        try {
+            ring.try_write(oversized.data(), oversized.size());
+            TEST_ASSERT(false);
+        } catch (std::length_error&) {
+        }
+
+        // the largest record fits in an empty ring at every offset, including those that wrap.
+        uc::jni::spsc_ring small(64);
+        TEST_ASSERT_EQUALS(28, small.max_size());
+        const std::string largest(small.max_size(), 'L');
+        for (int i = 0; i < 16; ++i) {
+            TEST_ASSERT(small.try_write(record.data(), 4));
+            TEST_ASSERT(small.try_read([](const void*, size_t) {}));
+            TEST_ASSERT(small.try_write(largest.data(), largest.size()));
+            size_t size = 0;
+            TEST_ASSERT(small.try_read([&](const void*, size_t n) { size = n; }));
+            TEST_ASSERT_EQUALS(largest.size(), size);
+        }
+        const std::string tooLarge(small.max_size() + 1, 'L');
+        try {
+            small.try_write(tooLarge.data(), tooLarge.size());
+            TEST_ASSERT(false);
+        } catch (std::length_error&) {
+        }
+    });
+}
+
+//*************************************************************************************************
+// Identity Locks
+//*************************************************************************************************
+JNI(void, testIdentityLocks)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        const auto hash = uc::jni::identity_hash(thiz);
+        TEST_ASSERT_EQUALS(hash, uc::jni::identity_hash(uc::jni::make_local(thiz)));
+        TEST_ASSERT_EQUALS(hash, uc::jni::identity_hash(uc::jni::make_global(thiz)));
+
+        uc::jni::identity_lock_table table(16);
+        TEST_ASSERT(&table.mutex(hash) == &table.mutex(uc::jni::identity_hash(thiz)));
+        {
+            // shared guards do not exclude each other, but exclude writers.
+            auto r1 = table.shared(hash);
+            auto r2 = table.shared(thiz);
+            bool readable = false;
+            bool writable = true;
+            std::thread([&] {
+                readable = table.mutex(hash).try_lock_shared();
+                if (readable) table.mutex(hash).unlock_shared();
+                writable = table.mutex(hash).try_lock();
+                if (writable) table.mutex(hash).unlock();
+            }).join();
+            TEST_ASSERT(readable);
+            TEST_ASSERT(!writable);
+        }
+        {
+            auto w = table.exclusive(thiz);
+            bool readable = true;
+            std::thread([&] {
+                readable = table.mutex(hash).try_lock_shared();
+                if (readable) table.mutex(hash).unlock_shared();
+            }).join();
+            TEST_ASSERT(!readable);
+        }
+
+        // native state guarded without JNI calls.
+        int counter = 0;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&] {
+                for (int i = 0; i < 10000; ++i) {
+                    auto lock = uc::jni::identity_locks().exclusive(hash);
+                    ++counter;
+                }
+            });
+        }
+        for (auto&& t : threads) t.join();
+        TEST_ASSERT_EQUALS(40000, counter);
+    });
+}
+
+//*************************************************************************************************
+// Unique References
+//*************************************************************************************************
+static_assert(sizeof(uc::jni::unique_global_ref<jstring>) == sizeof(jstring), "unique_global_ref must be pointer-sized");
+static_assert(sizeof(uc::jni::unique_weak_ref<jstring>) == sizeof(jweak), "unique_weak_ref must be pointer-sized");
+static_assert(sizeof(uc::jni::confined_global_ref<jstring>) == sizeof(void*), "confined_global_ref must be pointer-sized");
+static_assert(!std::is_copy_constructible<uc::jni::unique_weak_ref<jstring>>::value, "unique_weak_ref must be move-only");
+
+JNI(void, testUniqueRefs)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        auto jstr = uc::jni::to_jstring("Hello World");
+
+        auto global = uc::jni::make_unique_global(jstr);
+        TEST_ASSERT(global);
+        TEST_ASSERT_EQUALS(JNIGlobalRefType, env->GetObjectRefType(global.get()));
+        TEST_ASSERT(uc::jni::is_same_object(jstr, global));
+        TEST_ASSERT_EQUALS(std::string("Hello World"), uc::jni::to_string(global));
+
+        // as a method argument and a return type.
+        auto concat = uc::jni::make_method<jstring, uc::jni::unique_global_ref<jstring>(jstring)>("concat");
+        auto result = concat(global, global);
+        TEST_ASSERT_EQUALS(JNIGlobalRefType, env->GetObjectRefType(result.get()));
+        TEST_ASSERT_EQUALS(std::string("Hello WorldHello World"), uc::jni::to_string(result));
+
+        auto moved = std::move(global);
+        TEST_ASSERT(!global);
+        TEST_ASSERT(uc::jni::is_same_object(jstr, moved));
+
+        uc::jni::unique_weak_ref<jstring> weak(moved);
+        TEST_ASSERT(weak);
+        TEST_ASSERT(weak.is_same(jstr));
+        TEST_ASSERT(!weak.expired());
+        TEST_ASSERT(uc::jni::is_same_object(jstr, weak.lock()));
+        auto weak2 = std::move(weak);
+        TEST_ASSERT(!weak);
+        TEST_ASSERT(weak2.is_same(jstr));
+        weak2.reset();
+        TEST_ASSERT(!weak2);
+        TEST_ASSERT(uc::jni::make_unique_weak(result).is_same(result));
+
+        auto confined = uc::jni::make_confined_global(jstr);
+        TEST_ASSERT_EQUALS(1, confined.use_count());
+        {
+            auto copy = confined;
+            TEST_ASSERT_EQUALS(2, confined.use_count());
+            TEST_ASSERT(uc::jni::is_same_object(copy, jstr));
+            TEST_ASSERT_EQUALS(std::string("Hello World"), uc::jni::to_string(copy));
+        }
+        TEST_ASSERT_EQUALS(1, confined.use_count());
+        confined.reset();
+        TEST_ASSERT(!confined);
+    });
+}
+
+//*************************************************************************************************
+// Local Frames
+//*************************************************************************************************
+JNI(void, testLocalFrame)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        const auto before = uc::jni::ref_stats::local();
+        uc::jni::local_ref<jstring> result;
+        {
+            uc::jni::local_frame frame(64);
+            for (int i = 0; i < 1000; ++i) {
+                env->NewStringUTF(std::to_string(i).c_str());  // deleted by the frame
+            }
+            result = frame.pop(uc::jni::to_jstring("result"));
+        }
+        TEST_ASSERT_EQUALS(JNILocalRefType, env->GetObjectRefType(result.get()));
+        TEST_ASSERT_EQUALS(std::string("result"), uc::jni::to_string(result));
+        TEST_ASSERT_EQUALS(before.current + 1, uc::jni::ref_stats::local().current);
+        {
+            uc::jni::local_frame frame;
+            uc::jni::ensure_local_capacity(128);
+        }
+
+        // a transform that leaves one local reference per element runs in bounded frames.
+        constexpr jsize count = 100000;
+        std::vector<std::string> strings(count);
+        for (jsize i = 0; i < count; ++i) strings[i] = std::to_string(i);
+        auto array = uc::jni::new_array<jstring>(count);
+        uc::jni::set_region(array, 0, count, strings.begin(), [env](const std::string& str) { return env->NewStringUTF(str.c_str()); });
+        TEST_ASSERT_EQUALS(strings, uc::jni::to_vector<std::string>(array));
+        std::vector<std::string> copied(count);
+        uc::jni::get_region(array, 0, count, copied.begin(), [](auto&& str) { return uc::jni::to_string(str); });
+        TEST_ASSERT_EQUALS(strings, copied);
+
+        // local references in the result are not popped.
+        auto locals = uc::jni::to_vector<uc::jni::local_ref<jstring>>(uc::jni::to_jarray(std::vector<std::string>(300, "x")));
+        TEST_ASSERT_EQUALS(std::string("x"), uc::jni::to_string(locals.back()));
+    });
+}
+
+//*************************************************************************************************
+// Adopted Results
+//*************************************************************************************************
+JNI(void, testAdoptedResults)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        auto getFieldString = uc::jni::make_method<UcJniTest, jstring()>("getFieldString");
+        auto getFieldStringAsString = uc::jni::make_method<UcJniTest, std::string()>("getFieldString");
+        auto fieldString = uc::jni::make_field<UcJniTest, uc::jni::local_ref<jstring>>("fieldString");
+        auto fieldStringArray = uc::jni::make_field<UcJniTest, std::vector<std::string>>("fieldStringArray");
+
+        // the returned reference is owned by the result, not copied.
+        const auto before = uc::jni::ref_stats::local();
+        {
+            auto str = getFieldString(thiz);
+            TEST_ASSERT_EQUALS(JNILocalRefType, env->GetObjectRefType(str.get()));
+            TEST_ASSERT_EQUALS(std::string("Hello World!"), uc::jni::to_string(str));
+            auto field = fieldString.get(thiz);
+            TEST_ASSERT(uc::jni::is_same_object(str, field));
+        }
+        const auto after = uc::jni::ref_stats::local();
+        TEST_ASSERT_EQUALS(before.current, after.current);
+        TEST_ASSERT_EQUALS(before.deleted + (after.adopted - before.adopted), after.deleted);
+
+        // converted results release the returned reference at once, so a small frame is enough.
+        {
+            uc::jni::local_frame frame(16);
+            for (int i = 0; i < 10000; ++i) {
+                TEST_ASSERT_EQUALS(std::string("Hello World!"), getFieldStringAsString(thiz));
+                TEST_ASSERT_EQUALS(4, fieldStringArray.get(thiz).size());
+                getFieldString(thiz);
+            }
+        }
+    });
+}
+
+//*************************************************************************************************
+// Handle Table
+//*************************************************************************************************
+JNI(void, testHandleTable)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        uc::jni::handle_table<jstring> table(16);
+        auto hello = uc::jni::to_jstring("Hello");
+        const auto h = table.add(hello);
+        TEST_ASSERT(h != 0);
+        TEST_ASSERT_EQUALS(1, table.size());
+        TEST_ASSERT(table.contains(h));
+        TEST_ASSERT_EQUALS(std::string("Hello"), uc::jni::to_string(table.get(h)));
+        TEST_ASSERT_EQUALS(JNILocalRefType, env->GetObjectRefType(table.get(h).get()));
+
+        TEST_ASSERT(table.remove(h));
+        TEST_ASSERT(!table.remove(h));
+        TEST_ASSERT(!table.contains(h));
+        TEST_ASSERT(!table.get(h));
+
+        // the slot is reused with a new generation; the old handle stays dead.
+        const auto h2 = table.add(uc::jni::to_jstring("World"));
+        TEST_ASSERT(h2 != h);
+        TEST_ASSERT(!table.get(h));
+        TEST_ASSERT_EQUALS(std::string("World"), uc::jni::to_string(table.get(h2)));
+        TEST_ASSERT(table.remove(h2));
+
+        // handles cross threads; objects stay reachable without their own global references.
+        constexpr int threads = 4;
+        constexpr int count = 1000;
+        std::vector<uc::jni::handle_table<jstring>::handle_type> handles(threads * count);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                for (int i = 0; i < count; ++i) {
+                    handles[t * count + i] = table.add(uc::jni::to_jstring(std::to_string(t * count + i)));
+                }
+            });
+        }
+        for (auto&& w : workers) w.join();
+        TEST_ASSERT_EQUALS(threads * count, table.size());
+        gc();
+        std::atomic<int> mismatches { 0 };
+        workers.clear();
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                // each thread reads and removes the handles added by another one.
+                const auto other = (t + 1) % threads;
+                for (int i = 0; i < count; ++i) {
+                    const auto h = handles[other * count + i];
+                    if (uc::jni::to_string(table.get(h)) != std::to_string(other * count + i)) ++mismatches;
+                    if (!table.remove(h)) ++mismatches;
+                }
+            });
+        }
+        for (auto&& w : workers) w.join();
+        TEST_ASSERT_EQUALS(0, mismatches.load());
+        TEST_ASSERT_EQUALS(0, table.size());
+    });
+}
+
+//*************************************************************************************************
+// Peer Registry
+//*************************************************************************************************
+JNI(void, testPeerRegistry)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        uc::jni::peer_registry<std::string> peers(16);
+        const auto h = peers.add(std::make_shared<std::string>("Hello"));
+        TEST_ASSERT(h != 0);
+        TEST_ASSERT_EQUALS(1, peers.size());
+        TEST_ASSERT(peers.contains(h));
+        TEST_ASSERT_EQUALS(std::string("Hello"), *peers.get(h));
+
+        TEST_ASSERT(peers.release(h));
+        TEST_ASSERT(!peers.release(h));
+        TEST_ASSERT(!peers.contains(h));
+        TEST_ASSERT(!peers.get(h));
+
+        // the slot is reused with a new generation; the old handle stays dead.
+        const auto h2 = peers.add(std::make_shared<std::string>("World"));
+        TEST_ASSERT(h2 != h);
+        TEST_ASSERT(!peers.get(h));
+        TEST_ASSERT_EQUALS(std::string("World"), *peers.get(h2));
+        TEST_ASSERT(peers.release(h2));
+
+        // a peer outlives its handle while it is in use.
+        auto hold = std::make_shared<std::string>("Held");
+        const auto h3 = peers.add(hold);
+        auto used = peers.get(h3);
+        TEST_ASSERT(peers.release(h3));
+        TEST_ASSERT_EQUALS(std::string("Held"), *used);
+
+        // attached peers are released by the cleaner thread after their owners are collected.
+        std::weak_ptr<std::string> watched;
+        {
+            auto owner = uc::jni::to_jstring("owner");
+            auto peer = std::make_shared<std::string>("attached");
+            watched = peer;
+            const auto h4 = peers.attach(owner, std::move(peer));
+            TEST_ASSERT_EQUALS(std::string("attached"), *peers.get(h4));
+            const auto h5 = peers.attach(owner, std::make_shared<std::string>("released by hand"));
+            TEST_ASSERT(peers.release(h5));
+        }
+        for (int i = 0; i < 50 && peers.size() != 0; ++i) {
+            gc();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        TEST_ASSERT_EQUALS(0, peers.size());
+        TEST_ASSERT(watched.expired());
+    });
+}
+
+//*************************************************************************************************
+// Identity Maps
+//*************************************************************************************************
+JNI(void, testIdentityMap)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        uc::jni::identity_map<jstring, std::string> names;
+        auto hello = uc::jni::to_jstring("Hello");
+        auto hello2 = uc::jni::to_jstring("Hello");     // equal, but another object
+        int conversions = 0;
+        auto convert = [&](const uc::jni::local_ref<jstring>& s) {
+            return names.get_or_insert(s, [&] { ++conversions; return uc::jni::to_string(s); });
+        };
+        TEST_ASSERT_EQUALS(std::string("Hello"), convert(hello));
+        TEST_ASSERT_EQUALS(std::string("Hello"), convert(hello));
+        TEST_ASSERT_EQUALS(1, conversions);
+        TEST_ASSERT_EQUALS(std::string("Hello"), convert(hello2));
+        TEST_ASSERT_EQUALS(2, conversions);
+        TEST_ASSERT_EQUALS(2, names.size());
+
+        std::string value;
+        TEST_ASSERT(names.find(hello, value));
+        TEST_ASSERT_EQUALS(std::string("Hello"), value);
+        const auto hash = uc::jni::identity_hash(hello);
+        TEST_ASSERT(names.find(hash, hello, value));
+
+        names.insert_or_assign(hello, "World");
+        TEST_ASSERT(names.find(hello, value));
+        TEST_ASSERT_EQUALS(std::string("World"), value);
+        TEST_ASSERT(names.erase(hello));
+        TEST_ASSERT(!names.erase(hello));
+        TEST_ASSERT(!names.contains(hello));
+        TEST_ASSERT(names.contains(hello2));
+
+        // entries do not keep their keys alive.
+        hello2.reset();
+        for (int i = 0; i < 50 && names.size() != 0; ++i) {
+            gc();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            names.purge();
+        }
+        TEST_ASSERT_EQUALS(0, names.size());
+        TEST_ASSERT_EQUALS(0, names.purge());
+
+        // concurrent readers share one conversion per key.
+        std::vector<uc::jni::global_ref<jstring>> keys;
+        for (int i = 0; i < 64; ++i) {
+            keys.push_back(uc::jni::make_global(uc::jni::to_jstring(std::to_string(i))));
+        }
+        std::atomic<int> mismatches { 0 };
+        std::vector<std::thread> workers;
+        for (int t = 0; t < 4; ++t) {
+            workers.emplace_back([&] {
+                for (int round = 0; round < 10; ++round) {
+                    for (int i = 0; i < 64; ++i) {
+                        if (names.get_or_insert(keys[i], [&] { return uc::jni::to_string(keys[i]); }) != std::to_string(i)) ++mismatches;
+                    }
+                }
+            });
+        }
+        for (auto&& w : workers) w.join();
+        TEST_ASSERT_EQUALS(0, mismatches.load());
+        TEST_ASSERT_EQUALS(64, names.size());
+    });
+}
+
+//*************************************************************************************************
+// Object Pools
+//*************************************************************************************************
+JNI(void, testObjectPool)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        uc::jni::object_pool<jPoint> points([] { return jPoint_::new_(0.0, 0.0); }, [](jPoint p) { p->x(0.0).y(0.0); }, 2, 1);
+        TEST_ASSERT_EQUALS(1, points.idle());
+        TEST_ASSERT_EQUALS(1, points.created());
+
+        jobject first;
+        {
+            auto p = points.acquire();
+            TEST_ASSERT(p);
+            TEST_ASSERT_EQUALS(JNIGlobalRefType, env->GetObjectRefType(p.get()));
+            TEST_ASSERT_EQUALS(0, points.idle());
+            p->x(3.0).y(4.0);
+            TEST_ASSERT_EQUALS(5.0, p->norm());
+            first = env->NewLocalRef(p.get());
+        }
+        // the same object comes back, reset.
+        TEST_ASSERT_EQUALS(1, points.idle());
+        {
+            auto p = points.acquire();
+            TEST_ASSERT(env->IsSameObject(first, p.get()));
+            TEST_ASSERT_EQUALS(0.0, p->x());
+            TEST_ASSERT_EQUALS(0.0, p->y());
+            TEST_ASSERT_EQUALS(1, points.created());
+        }
+        env->DeleteLocalRef(first);
+
+        // an empty pool constructs; a full pool drops what comes back.
+        {
+            auto p1 = points.acquire();
+            auto p2 = points.acquire();
+            auto p3 = points.acquire();
+            TEST_ASSERT_EQUALS(3, points.created());
+        }
+        TEST_ASSERT_EQUALS(2, points.idle());
+
+        // an object released to Java leaves the pool until it is recycled.
+        auto kept = points.acquire().release();
+        TEST_ASSERT_EQUALS(1, points.idle());
+        kept->x(1.0);
+        points.recycle(std::move(kept));
+        TEST_ASSERT(!kept);
+        TEST_ASSERT_EQUALS(2, points.idle());
+
+        // threads share the pool.
+        std::atomic<int> mismatches { 0 };
+        std::vector<std::thread> workers;
+        for (int t = 0; t < 4; ++t) {
+            workers.emplace_back([&, t] {
+                for (int i = 0; i < 1000; ++i) {
+                    auto p = points.acquire();
+                    if (p->x() != 0.0) ++mismatches;
+                    p->x(t + 1.0);
+                    if (p->x() != t + 1.0) ++mismatches;
+                }
+            });
+        }
+        for (auto&& w : workers) w.join();
+        TEST_ASSERT_EQUALS(0, mismatches.load());
+        TEST_ASSERT_EQUALS(2, points.idle());
+
+        // a lease that outlives its pool deletes its object instead of recycling it.
+        uc::jni::object_pool<jPoint>::lease orphan;
+        {
+            uc::jni::object_pool<jPoint> shortLived([] { return jPoint_::new_(0.0, 0.0); }, [](jPoint p) { p->x(0.0).y(0.0); }, 2);
+            orphan = shortLived.acquire();
+        }
+        orphan->x(2.0);
+        TEST_ASSERT_EQUALS(2.0, orphan->x());
+        orphan = uc::jni::object_pool<jPoint>::lease();
+        TEST_ASSERT(!orphan);
+    });
+}
+
+//*************************************************************************************************
+// Class Cache
+//*************************************************************************************************
+JNI(void, testClassCache)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        uc::jni::prefetch_classes({ "com/example/uc/ucjnitest/Point", "java/lang/String" });
+        auto point = uc::jni::find_class("com/example/uc/ucjnitest/Point");
+        TEST_ASSERT(uc::jni::is_same_object(point, uc::jni::get_class<jPoint>()));
+        TEST_ASSERT_EQUALS(JNILocalRefType, env->GetObjectRefType(point.get()));
+
+        // a missing class throws every time; failures are not cached.
+        for (int i = 0; i < 2; ++i) {
+            bool thrown = false;
+            try {
+                uc::jni::find_class("com/example/uc/ucjnitest/NoSuchClass");
+            } catch (std::exception&) {
+                thrown = true;
+            }
+            TEST_ASSERT(thrown);
+            TEST_ASSERT(!env->ExceptionCheck());
+        }
+
+        // app classes resolve from native threads through the class loader set in JNI_OnLoad().
+        std::atomic<int> mismatches { 0 };
+        std::vector<std::thread> workers;
+        for (int t = 0; t < 4; ++t) {
+            workers.emplace_back([&] {
+                for (int i = 0; i < 1000; ++i) {
+                    const char* fqcn = (i % 2) ? "com/example/uc/ucjnitest/Point" : "com/example/uc/ucjnitest/UcJniTest$InnerA";
+                    auto cls = uc::jni::find_class(fqcn);
+                    if (!cls) ++mismatches;
+                    if ((i % 2) && !uc::jni::is_same_object(cls, uc::jni::get_class<jPoint>())) ++mismatches;
+                }
+            });
+        }
+        for (auto&& w : workers) w.join();
+        TEST_ASSERT_EQUALS(0, mismatches.load());
+    });
+}
+
+//*************************************************************************************************
+// ID Registry
+//*************************************************************************************************
+static_assert(uc::jni::get_signature<void(jPoint, double)>()[0] == '(', "signatures are constant data");
+
+// used only by testIdRegistry, so nothing has resolved its IDs before.
+UC_JNI_DEFINE_JCLASS(jStringBuilder, java/lang/StringBuilder)
+{
+    UC_JNI_DEFINE_JCLASS_CONSTRUCTOR(std::string)
+    UC_JNI_DEFINE_JCLASS_METHOD(jint, length)
+    // overloads declared on one line get their own IDs.
+    UC_JNI_DEFINE_JCLASS_METHOD(jStringBuilder, append, std::string) UC_JNI_DEFINE_JCLASS_OVERLOADED_METHOD(jStringBuilder, append, jint)
+};
+
+JNI(void, testIdRegistry)(JNIEnv *env, jobject thiz)
+{
+    uc::jni::exception_guard([&] {
+        // the constructor, length() and both append() registered at load time; all resolve before their first call.
+        TEST_ASSERT_EQUALS(4, jStringBuilder_::resolve_ids());
+        TEST_ASSERT_EQUALS(0, jStringBuilder_::resolve_ids());
+        auto builder = jStringBuilder_::new_(std::string("hello"));
+        TEST_ASSERT_EQUALS(5, builder->length());
+        builder->append(std::string(" world"));
+        builder->append(1);
+        TEST_ASSERT_EQUALS(12, builder->length());
+        TEST_ASSERT_EQUALS(0, jStringBuilder_::resolve_ids());
+
+        // resolves every ID jPoint's macros declare in one pass; later calls look nothing up.
+        jPoint_::resolve_ids();
+        uc::jni::resolve_ids<InnerA>();
+
+        auto p = jPoint_::new_(3.0, 4.0);
+        TEST_ASSERT_EQUALS(5.0, p->norm());
+        p->x(6.0).y(8.0);
+        TEST_ASSERT_EQUALS(10.0, p->norm());
+        auto q = jPoint_::add(p, jPoint_::new_(p));
+        TEST_ASSERT_EQUALS(12.0, q->x());
+        TEST_ASSERT_EQUALS(16.0, q->y());
+        TEST_ASSERT_EQUALS(0, uc::jni::alloc_audit::count([&] { p->x(1.0).y(p->x()); }));
+
+        // once everything is resolved, resolving again is a no-op on any thread.
+        uc::jni::resolve_all_ids();
+        std::atomic<int> mismatches { 0 };
+        std::atomic<size_t> resolved { 0 };
+        std::vector<std::thread> workers;
+        for (int t = 0; t < 4; ++t) {
+            workers.emplace_back([&] {
+                resolved += uc::jni::resolve_all_ids();
+                for (int i = 0; i < 1000; ++i) {
+                    if (jPoint_::ZERO()->x() != 0.0) ++mismatches;
+                }
+            });
+        }
+        for (auto&& w : workers) w.join();
+        TEST_ASSERT_EQUALS(0, mismatches.load());
+        TEST_ASSERT_EQUALS(0u, resolved.load());
+        TEST_ASSERT_EQUALS(0, uc::jni::resolve_all_ids());
+    });
+}
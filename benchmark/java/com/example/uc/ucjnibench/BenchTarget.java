@@ -0,0 +1,64 @@
+package com.example.uc.ucjnibench;
+
+import java.nio.ByteBuffer;
+
+/**
+ * Target object of the uc-jni desktop benchmark.
+ */
+public class BenchTarget {
+    public static int staticFieldInt = 0;
+
+    public int    fieldInt    = 1;
+    public double fieldDouble = 2;
+    public String fieldString = "Hello World!";
+
+    public BenchTarget() {}
+    public BenchTarget(int i, double d) { fieldInt = i; fieldDouble = d; }
+
+    public static int add(int a, int b) { return a + b; }
+
+    public void   doNothing() {}
+    public int    getInt() { return fieldInt; }
+    public void   setInt(int value) { fieldInt = value; }
+    public double getDouble() { return fieldDouble; }
+    public String getString() { return fieldString; }
+    public void   setString(String value) { fieldString = value; }
+
+    // per-record upcall, compared with the ring buffer.
+    public static long consumedBytes = 0;
+    public static void consume(byte[] record) { consumedBytes += record.length; }
+
+    private static volatile boolean ringRunning;
+    private static long ringBytes;
+    private static Thread ringThread;
+
+    /** drains a uc::jni::spsc_ring on a Java thread until stopRingConsumer(). */
+    public static void startRingConsumer(ByteBuffer buffer) {
+        final SpscRingBuffer ring = new SpscRingBuffer(buffer);
+        ringRunning = true;
+        ringBytes = 0;
+        ringThread = new Thread(new Runnable() {
+            @Override public void run() {
+                final byte[] record = new byte[4096];
+                for (;;) {
+                    final boolean running = ringRunning;
+                    final int length = ring.poll(record);
+                    if (length >= 0) {
+                        ringBytes += length;
+                    } else if (!running) {
+                        break;
+                    } else {
+                        Thread.onSpinWait();
+                    }
+                }
+            }
+        }, "uc-jni-bench-ring");
+        ringThread.start();
+    }
+    /** @return bytes consumed since startRingConsumer(). */
+    public static long stopRingConsumer() throws InterruptedException {
+        ringRunning = false;
+        ringThread.join();
+        return ringBytes;
+    }
+}
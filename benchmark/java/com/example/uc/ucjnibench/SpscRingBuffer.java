@@ -0,0 +1,139 @@
+package com.example.uc.ucjnibench;
+
+import java.lang.invoke.MethodHandles;
+import java.lang.invoke.VarHandle;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.util.concurrent.locks.LockSupport;
+
+/**
+ * Java side of uc::jni::spsc_ring.
+ *
+ * head and tail are read with getAcquire and published with setRelease through VarHandles
+ * over the shared direct ByteBuffer, so either side may be native.
+ * A record may occupy at most half the data area, as in spsc_ring::max_size().
+ * Requires Java 9 or later (Android API level 33 or later).
+ */
+public final class SpscRingBuffer {
+    static final int HEAD = 0;
+    static final int TAIL = 64;
+    static final int DATA = 128;
+    static final int PADDING = -1;
+
+    private static final VarHandle LONG = MethodHandles.byteBufferViewVarHandle(long[].class, ByteOrder.nativeOrder());
+    private static final VarHandle INT = MethodHandles.byteBufferViewVarHandle(int[].class, ByteOrder.nativeOrder());
+
+    private final ByteBuffer buffer;
+    private final ByteBuffer writer;
+    private final ByteBuffer reader;
+    private final int capacity;
+    private long tailCache;
+    private long headCache;
+
+    /** @param buffer the buffer returned by spsc_ring::buffer(), or a zero-filled ByteBuffer.allocateDirect(). */
+    public SpscRingBuffer(ByteBuffer buffer) {
+        final int size = buffer.capacity() - DATA;
+        if (!buffer.isDirect() || size < 64 || (size & (size - 1)) != 0 || buffer.alignmentOffset(0, 8) != 0) {
+            throw new IllegalArgumentException("unsupported buffer");
+        }
+        this.buffer = buffer.duplicate().order(ByteOrder.nativeOrder());
+        this.writer = buffer.duplicate();
+        this.reader = buffer.duplicate();
+        this.capacity = size;
+    }
+
+    public int capacity() {
+        return capacity;
+    }
+
+    /** the largest record length offer() accepts. */
+    public int maxLength() {
+        return capacity / 2 - 4;
+    }
+
+    /** producer. @return false if the ring is full. */
+    public boolean offer(byte[] src, int offset, int length) {
+        if (length > maxLength()) {
+            throw new IllegalArgumentException("record too large");
+        }
+        final int recordSize = recordSize(length);
+        long head = (long) LONG.getOpaque(buffer, HEAD);
+        int pos = (int) head & (capacity - 1);
+        final int padding = (pos + recordSize > capacity) ? capacity - pos : 0;
+        if (head + padding + recordSize - tailCache > capacity) {
+            tailCache = (long) LONG.getAcquire(buffer, TAIL);
+            if (head + padding + recordSize - tailCache > capacity) {
+                return false;
+            }
+        }
+        if (padding != 0) {
+            INT.set(buffer, DATA + pos, PADDING);
+            head += padding;
+            pos = 0;
+        }
+        INT.set(buffer, DATA + pos, length);
+        writer.position(DATA + pos + 4);
+        writer.put(src, offset, length);
+        LONG.setRelease(buffer, HEAD, head + recordSize);
+        return true;
+    }
+
+    /** waits while the ring is full. */
+    public void put(byte[] src, int offset, int length, boolean park) {
+        for (int attempt = 0; !offer(src, offset, length); ++attempt) {
+            pause(park, attempt);
+        }
+    }
+
+    /**
+     * consumer. copies the oldest record into dst.
+     * @return the record length, or -1 if the ring is empty.
+     */
+    public int poll(byte[] dst) {
+        long tail = (long) LONG.getOpaque(buffer, TAIL);
+        if (tail == headCache) {
+            headCache = (long) LONG.getAcquire(buffer, HEAD);
+            if (tail == headCache) {
+                return -1;
+            }
+        }
+        int pos = (int) tail & (capacity - 1);
+        int length = (int) INT.get(buffer, DATA + pos);
+        if (length == PADDING) {
+            tail += capacity - pos;
+            pos = 0;
+            length = (int) INT.get(buffer, DATA + pos);
+        }
+        if (length > dst.length) {
+            throw new IllegalArgumentException("record of " + length + " bytes does not fit");
+        }
+        reader.position(DATA + pos + 4);
+        reader.get(dst, 0, length);
+        LONG.setRelease(buffer, TAIL, tail + recordSize(length));
+        return length;
+    }
+
+    /** waits while the ring is empty. @return the record length. */
+    public int take(byte[] dst, boolean park) {
+        int length;
+        for (int attempt = 0; (length = poll(dst)) < 0; ++attempt) {
+            pause(park, attempt);
+        }
+        return length;
+    }
+
+    private static int recordSize(int length) {
+        return (4 + length + 7) & ~7;
+    }
+
+    // spin, then yield, then park up to 1ms, like spsc_ring::wait_mode::park.
+    private static void pause(boolean park, int attempt) {
+        if (!park || attempt < 64) {
+            Thread.onSpinWait();
+        } else if (attempt < 128) {
+            Thread.yield();
+        } else {
+            LockSupport.parkNanos(1000L << Math.min(attempt - 128, 10));
+        }
+    }
+}
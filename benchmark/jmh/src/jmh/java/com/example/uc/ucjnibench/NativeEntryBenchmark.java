@@ -0,0 +1,77 @@
+package com.example.uc.ucjnibench;
+
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Fork;
+import org.openjdk.jmh.annotations.Measurement;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.OutputTimeUnit;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.State;
+import org.openjdk.jmh.annotations.Warmup;
+
+import java.util.concurrent.TimeUnit;
+
+/**
+ * Java to native entry cost per binding style and argument count.
+ * Run with "-prof gc" (default in build.gradle) to get allocation rates.
+ */
+@State(Scope.Thread)
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(TimeUnit.NANOSECONDS)
+@Warmup(iterations = 3, time = 1)
+@Measurement(iterations = 5, time = 1)
+@Fork(1)
+public class NativeEntryBenchmark {
+    NativeEntry target = new NativeEntry();
+    int i0 = 0, i1 = 1, i2 = 2, i3 = 3, i4 = 4, i5 = 5, i6 = 6, i7 = 7;
+    Object o0 = new Object(), o1 = "1", o2 = 2, o3 = new int[3], o4 = new Object(), o5 = "5", o6 = 6, o7 = new int[7];
+
+    // pure Java call for reference
+    @Benchmark public int javaBaseline() { return i0 + i1; }
+
+    @Benchmark public int exported0() { return target.exported0(); }
+    @Benchmark public int exportedGuarded0() { return target.exportedGuarded0(); }
+    @Benchmark public int registered0() { return target.registered0(); }
+    @Benchmark public int registeredGuarded0() { return target.registeredGuarded0(); }
+
+    @Benchmark public int exportedI1() { return target.exportedI1(i0); }
+    @Benchmark public int exportedGuardedI1() { return target.exportedGuardedI1(i0); }
+    @Benchmark public int registeredI1() { return target.registeredI1(i0); }
+    @Benchmark public int registeredGuardedI1() { return target.registeredGuardedI1(i0); }
+
+    @Benchmark public int exportedI2() { return target.exportedI2(i0, i1); }
+    @Benchmark public int exportedGuardedI2() { return target.exportedGuardedI2(i0, i1); }
+    @Benchmark public int registeredI2() { return target.registeredI2(i0, i1); }
+    @Benchmark public int registeredGuardedI2() { return target.registeredGuardedI2(i0, i1); }
+
+    @Benchmark public int exportedI4() { return target.exportedI4(i0, i1, i2, i3); }
+    @Benchmark public int exportedGuardedI4() { return target.exportedGuardedI4(i0, i1, i2, i3); }
+    @Benchmark public int registeredI4() { return target.registeredI4(i0, i1, i2, i3); }
+    @Benchmark public int registeredGuardedI4() { return target.registeredGuardedI4(i0, i1, i2, i3); }
+
+    @Benchmark public int exportedI8() { return target.exportedI8(i0, i1, i2, i3, i4, i5, i6, i7); }
+    @Benchmark public int exportedGuardedI8() { return target.exportedGuardedI8(i0, i1, i2, i3, i4, i5, i6, i7); }
+    @Benchmark public int registeredI8() { return target.registeredI8(i0, i1, i2, i3, i4, i5, i6, i7); }
+    @Benchmark public int registeredGuardedI8() { return target.registeredGuardedI8(i0, i1, i2, i3, i4, i5, i6, i7); }
+
+    @Benchmark public int exportedL1() { return target.exportedL1(o0); }
+    @Benchmark public int exportedGuardedL1() { return target.exportedGuardedL1(o0); }
+    @Benchmark public int registeredL1() { return target.registeredL1(o0); }
+    @Benchmark public int registeredGuardedL1() { return target.registeredGuardedL1(o0); }
+
+    @Benchmark public int exportedL2() { return target.exportedL2(o0, o1); }
+    @Benchmark public int exportedGuardedL2() { return target.exportedGuardedL2(o0, o1); }
+    @Benchmark public int registeredL2() { return target.registeredL2(o0, o1); }
+    @Benchmark public int registeredGuardedL2() { return target.registeredGuardedL2(o0, o1); }
+
+    @Benchmark public int exportedL4() { return target.exportedL4(o0, o1, o2, o3); }
+    @Benchmark public int exportedGuardedL4() { return target.exportedGuardedL4(o0, o1, o2, o3); }
+    @Benchmark public int registeredL4() { return target.registeredL4(o0, o1, o2, o3); }
+    @Benchmark public int registeredGuardedL4() { return target.registeredGuardedL4(o0, o1, o2, o3); }
+
+    @Benchmark public int exportedL8() { return target.exportedL8(o0, o1, o2, o3, o4, o5, o6, o7); }
+    @Benchmark public int exportedGuardedL8() { return target.exportedGuardedL8(o0, o1, o2, o3, o4, o5, o6, o7); }
+    @Benchmark public int registeredL8() { return target.registeredL8(o0, o1, o2, o3, o4, o5, o6, o7); }
+    @Benchmark public int registeredGuardedL8() { return target.registeredGuardedL8(o0, o1, o2, o3, o4, o5, o6, o7); }
+}
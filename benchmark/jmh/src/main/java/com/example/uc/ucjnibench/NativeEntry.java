@@ -0,0 +1,58 @@
+package com.example.uc.ucjnibench;
+
+/**
+ * Native entries for {@link NativeEntryBenchmark}.
+ * All entries have the same trivial body; they differ only in binding style.
+ * <ul>
+ * <li>exported*          : exported {@code Java_...} symbol</li>
+ * <li>exportedGuarded*   : exported symbol, body wrapped with uc::jni::exception_guard()</li>
+ * <li>registered*        : bound by uc::jni::register_natives()</li>
+ * <li>registeredGuarded* : bound by uc::jni::register_natives(), body wrapped with uc::jni::exception_guard()</li>
+ * </ul>
+ * Suffix: 0 = no argument, In = n int arguments, Ln = n Object arguments.
+ */
+public class NativeEntry {
+    static {
+        System.loadLibrary("uc-jni-entry");
+    }
+
+    public native int exported0();
+    public native int exportedI1(int a0);
+    public native int exportedI2(int a0, int a1);
+    public native int exportedI4(int a0, int a1, int a2, int a3);
+    public native int exportedI8(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7);
+    public native int exportedL1(Object a0);
+    public native int exportedL2(Object a0, Object a1);
+    public native int exportedL4(Object a0, Object a1, Object a2, Object a3);
+    public native int exportedL8(Object a0, Object a1, Object a2, Object a3, Object a4, Object a5, Object a6, Object a7);
+
+    public native int exportedGuarded0();
+    public native int exportedGuardedI1(int a0);
+    public native int exportedGuardedI2(int a0, int a1);
+    public native int exportedGuardedI4(int a0, int a1, int a2, int a3);
+    public native int exportedGuardedI8(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7);
+    public native int exportedGuardedL1(Object a0);
+    public native int exportedGuardedL2(Object a0, Object a1);
+    public native int exportedGuardedL4(Object a0, Object a1, Object a2, Object a3);
+    public native int exportedGuardedL8(Object a0, Object a1, Object a2, Object a3, Object a4, Object a5, Object a6, Object a7);
+
+    public native int registered0();
+    public native int registeredI1(int a0);
+    public native int registeredI2(int a0, int a1);
+    public native int registeredI4(int a0, int a1, int a2, int a3);
+    public native int registeredI8(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7);
+    public native int registeredL1(Object a0);
+    public native int registeredL2(Object a0, Object a1);
+    public native int registeredL4(Object a0, Object a1, Object a2, Object a3);
+    public native int registeredL8(Object a0, Object a1, Object a2, Object a3, Object a4, Object a5, Object a6, Object a7);
+
+    public native int registeredGuarded0();
+    public native int registeredGuardedI1(int a0);
+    public native int registeredGuardedI2(int a0, int a1);
+    public native int registeredGuardedI4(int a0, int a1, int a2, int a3);
+    public native int registeredGuardedI8(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7);
+    public native int registeredGuardedL1(Object a0);
+    public native int registeredGuardedL2(Object a0, Object a1);
+    public native int registeredGuardedL4(Object a0, Object a1, Object a2, Object a3);
+    public native int registeredGuardedL8(Object a0, Object a1, Object a2, Object a3, Object a4, Object a5, Object a6, Object a7);
+}
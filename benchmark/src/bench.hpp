@@ -0,0 +1,194 @@
+/**
+uc::jni <https://github.com/uctakeoff/uc-jni>
+Copyright (c) 2018, Kentaro Ushiyama
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+#ifndef UC_JNI_BENCH_HPP
+#define UC_JNI_BENCH_HPP
+#include <jni.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace uc {
+namespace bench {
+
+//*************************************************************************************************
+// Options
+//*************************************************************************************************
+
+struct options
+{
+    std::size_t iterations = 100000;
+    std::size_t repetitions = 7;
+    std::size_t threads = 0;
+    std::string filter;
+    std::string output;
+
+    static options parse(int argc, char** argv)
+    {
+        options opt;
+        for (int i = 1; i < argc; ++i) {
+            auto arg = std::string(argv[i]);
+            auto next = [&]() -> std::string { return (i + 1 < argc) ? argv[++i] : ""; };
+            if (arg == "--quick") {
+                opt.iterations = 1000;
+                opt.repetitions = 3;
+            } else if (arg == "--iterations") {
+                opt.iterations = std::stoul(next());
+            } else if (arg == "--repetitions") {
+                opt.repetitions = std::stoul(next());
+            } else if (arg == "--threads") {
+                opt.threads = std::stoul(next());
+            } else if (arg == "--filter") {
+                opt.filter = next();
+            } else if (arg == "--out") {
+                opt.output = next();
+            }
+        }
+        return opt;
+    }
+};
+
+//*************************************************************************************************
+// Helpers
+//*************************************************************************************************
+
+//! prevent the compiler from discarding a benchmarked value.
+template <typename T> inline void do_not_optimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline std::string json_escape(const std::string& str)
+{
+    std::string ret;
+    ret.reserve(str.size());
+    for (auto c : str) {
+        switch (c) {
+        case '"':  ret += "\\\""; break;
+        case '\\': ret += "\\\\"; break;
+        case '\n': ret += "\\n"; break;
+        case '\t': ret += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                ret += buf;
+            } else {
+                ret += c;
+            }
+        }
+    }
+    return ret;
+}
+
+using context_type = std::vector<std::pair<std::string, std::string>>;
+
+inline void write_json_context(std::ostream& os, const context_type& context)
+{
+    os << "  \"context\": {";
+    const char* sep = "\n";
+    for (auto&& kv : context) {
+        os << sep << "    \"" << json_escape(kv.first) << "\": \"" << json_escape(kv.second) << "\"";
+        sep = ",\n";
+    }
+    os << "\n  }";
+}
+
+//*************************************************************************************************
+// Runner
+//*************************************************************************************************
+
+struct result
+{
+    std::string group;
+    std::string variant;
+    std::size_t iterations;
+    std::size_t repetitions;
+    double ns_per_op_median;
+    double ns_per_op_min;
+    double ns_per_op_max;
+};
+
+class runner
+{
+public:
+    runner(JNIEnv* env, const options& opt) : env_(env), opt_(opt)
+    {
+    }
+
+    //! run "func" (iterations x repetitions) times and record ns/op.
+    //! each repetition runs inside its own local frame, so leaked local references do not accumulate.
+    template <typename F> void run(const char* group, const char* variant, F&& func)
+    {
+        if (!selected(group)) return;
+
+        run_repetition(std::max<std::size_t>(opt_.iterations / 10, 1), func);
+
+        std::vector<double> samples;
+        samples.reserve(opt_.repetitions);
+        for (std::size_t r = 0; r < opt_.repetitions; ++r) {
+            samples.push_back(run_repetition(opt_.iterations, func));
+        }
+        std::sort(samples.begin(), samples.end());
+        results_.push_back(result{ group, variant, opt_.iterations, opt_.repetitions,
+            samples[samples.size() / 2], samples.front(), samples.back() });
+
+        std::fprintf(stderr, "%-40s %-8s %12.1f ns/op\n", group, variant, samples[samples.size() / 2]);
+    }
+
+    bool selected(const char* group) const
+    {
+        return opt_.filter.empty() || std::strstr(group, opt_.filter.c_str()) != nullptr;
+    }
+
+    const std::vector<result>& results() const noexcept
+    {
+        return results_;
+    }
+
+    void write_json(std::ostream& os, const context_type& context) const
+    {
+        os << "{\n";
+        write_json_context(os, context);
+        os << ",\n  \"benchmarks\": [";
+        const char* sep = "\n";
+        for (auto&& r : results_) {
+            os << sep << "    {\"group\": \"" << json_escape(r.group) << "\", \"variant\": \"" << json_escape(r.variant) << "\""
+               << ", \"iterations\": " << r.iterations << ", \"repetitions\": " << r.repetitions
+               << ", \"ns_per_op\": " << r.ns_per_op_median
+               << ", \"ns_per_op_min\": " << r.ns_per_op_min
+               << ", \"ns_per_op_max\": " << r.ns_per_op_max << "}";
+            sep = ",\n";
+        }
+        os << "\n  ]\n}\n";
+    }
+
+private:
+    template <typename F> double run_repetition(std::size_t iterations, F& func)
+    {
+        using clock_type = std::chrono::steady_clock;
+        env_->PushLocalFrame(16);
+        const auto start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i) {
+            func();
+        }
+        const auto end = clock_type::now();
+        env_->PopLocalFrame(nullptr);
+        return std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(iterations);
+    }
+
+    JNIEnv* env_;
+    options opt_;
+    std::vector<result> results_;
+};
+
+}
+}
+#endif
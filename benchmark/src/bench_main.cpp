@@ -0,0 +1,701 @@
+/**
+uc::jni <https://github.com/uctakeoff/uc-jni>
+Copyright (c) 2018, Kentaro Ushiyama
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+#include "jvm.hpp"
+#include "bench.hpp"
+#include "scaling.hpp"
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <thread>
+
+#define BENCH_TARGET_FQCN "com/example/uc/ucjnibench/BenchTarget"
+
+using uc::bench::do_not_optimize;
+using uc::bench::runner;
+
+//*************************************************************************************************
+// Wrapper Classes
+//*************************************************************************************************
+UC_JNI_DEFINE_JCLASS(jBenchTarget, com/example/uc/ucjnibench/BenchTarget)
+{
+    UC_JNI_DEFINE_JCLASS_CONSTRUCTOR(jint, jdouble)
+    UC_JNI_DEFINE_JCLASS_STATIC_METHOD(jint, add, jint, jint)
+    UC_JNI_DEFINE_JCLASS_FIELD(jint, fieldInt)
+    UC_JNI_DEFINE_JCLASS_METHOD(jint, getInt)
+};
+
+namespace {
+
+struct fixture
+{
+    JNIEnv* env;
+    jclass clazz;
+    jobject obj;
+};
+
+//*************************************************************************************************
+// Class and Method IDs
+//*************************************************************************************************
+void bench_class(runner& r, const fixture& f)
+{
+    auto e = f.env;
+    r.run("get_class", "uc-jni", [&] {
+        do_not_optimize(uc::jni::get_class<jBenchTarget>());
+    });
+    r.run("get_class", "raw", [&] {
+        auto cls = e->FindClass(BENCH_TARGET_FQCN);
+        do_not_optimize(cls);
+        e->DeleteLocalRef(cls);
+    });
+    r.run("find_class", "uc-jni", [&] {
+        auto cls = uc::jni::find_class(BENCH_TARGET_FQCN);
+        do_not_optimize(cls.get());
+    });
+    r.run("find_class", "raw", [&] {
+        auto cls = e->FindClass(BENCH_TARGET_FQCN);
+        do_not_optimize(cls);
+        e->DeleteLocalRef(cls);
+    });
+    r.run("make_method", "uc-jni", [&] {
+        do_not_optimize(uc::jni::make_method<jBenchTarget, jint()>("getInt"));
+    });
+    r.run("make_method", "raw", [&] {
+        do_not_optimize(e->GetMethodID(f.clazz, "getInt", "()I"));
+    });
+}
+
+//*************************************************************************************************
+// Calling Methods
+//*************************************************************************************************
+void bench_method(runner& r, const fixture& f)
+{
+    auto e = f.env;
+    {
+        auto m = uc::jni::make_method<jBenchTarget, void()>("doNothing");
+        auto id = e->GetMethodID(f.clazz, "doNothing", "()V");
+        r.run("method/void()", "uc-jni", [&] {
+            m(f.obj);
+        });
+        r.run("method/void()", "raw", [&] {
+            e->CallVoidMethod(f.obj, id);
+            if (e->ExceptionCheck()) throw std::runtime_error("doNothing");
+        });
+    }
+    {
+        auto m = uc::jni::make_method<jBenchTarget, jint()>("getInt");
+        auto id = e->GetMethodID(f.clazz, "getInt", "()I");
+        r.run("method/int()", "uc-jni", [&] {
+            do_not_optimize(m(f.obj));
+        });
+        r.run("method/int()", "env", [&] {
+            do_not_optimize(m.call(e, f.obj));
+        });
+        r.run("method/int()", "macro", [&] {
+            do_not_optimize(static_cast<jBenchTarget>(f.obj)->getInt());
+        });
+        r.run("method/int()", "raw", [&] {
+            auto v = e->CallIntMethod(f.obj, id);
+            if (e->ExceptionCheck()) throw std::runtime_error("getInt");
+            do_not_optimize(v);
+        });
+    }
+    {
+        auto m = uc::jni::make_method<jBenchTarget, void(jint)>("setInt");
+        auto id = e->GetMethodID(f.clazz, "setInt", "(I)V");
+        r.run("method/void(int)", "uc-jni", [&] {
+            m(f.obj, 1);
+        });
+        r.run("method/void(int)", "raw", [&] {
+            e->CallVoidMethod(f.obj, id, 1);
+            if (e->ExceptionCheck()) throw std::runtime_error("setInt");
+        });
+    }
+    {
+        auto m = uc::jni::make_method<jBenchTarget, jstring()>("getString");
+        auto id = e->GetMethodID(f.clazz, "getString", "()Ljava/lang/String;");
+        r.run("method/String()", "uc-jni", [&] {
+            auto s = m(f.obj);
+            do_not_optimize(s.get());
+        });
+        r.run("method/String()", "env", [&] {
+            auto s = m.call(e, f.obj);
+            do_not_optimize(s.get());
+        });
+        r.run("method/String()", "raw", [&] {
+            auto s = e->CallObjectMethod(f.obj, id);
+            if (e->ExceptionCheck()) throw std::runtime_error("getString");
+            do_not_optimize(s);
+            e->DeleteLocalRef(s);
+        });
+    }
+    {
+        auto m = uc::jni::make_method<jBenchTarget, std::string()>("getString");
+        auto id = e->GetMethodID(f.clazz, "getString", "()Ljava/lang/String;");
+        r.run("method/String()->std::string", "uc-jni", [&] {
+            do_not_optimize(m(f.obj));
+        });
+        r.run("method/String()->std::string", "raw", [&] {
+            auto s = static_cast<jstring>(e->CallObjectMethod(f.obj, id));
+            if (e->ExceptionCheck()) throw std::runtime_error("getString");
+            std::string ret(e->GetStringUTFLength(s), 0);
+            e->GetStringUTFRegion(s, 0, e->GetStringLength(s), &ret[0]);
+            e->DeleteLocalRef(s);
+            do_not_optimize(ret);
+        });
+    }
+    {
+        auto m = uc::jni::make_static_method<jBenchTarget, jint(jint, jint)>("add");
+        auto id = e->GetStaticMethodID(f.clazz, "add", "(II)I");
+        r.run("static_method/int(int,int)", "uc-jni", [&] {
+            do_not_optimize(m(1, 2));
+        });
+        r.run("static_method/int(int,int)", "env", [&] {
+            do_not_optimize(m.call(e, 1, 2));
+        });
+        r.run("static_method/int(int,int)", "macro", [&] {
+            do_not_optimize(jBenchTarget_::add(1, 2));
+        });
+        r.run("static_method/int(int,int)", "raw", [&] {
+            auto v = e->CallStaticIntMethod(f.clazz, id, 1, 2);
+            if (e->ExceptionCheck()) throw std::runtime_error("add");
+            do_not_optimize(v);
+        });
+    }
+    {
+        auto ctor = uc::jni::make_constructor<jBenchTarget(jint, jdouble)>();
+        auto id = e->GetMethodID(f.clazz, "<init>", "(ID)V");
+        r.run("constructor/(int,double)", "uc-jni", [&] {
+            auto o = ctor(1, 2.0);
+            do_not_optimize(o.get());
+        });
+        r.run("constructor/(int,double)", "env", [&] {
+            auto o = ctor.call(e, 1, 2.0);
+            do_not_optimize(o.get());
+        });
+        // refills a pooled object instead of allocating one; the reset hook runs on return.
+        uc::jni::object_pool<jBenchTarget> pool([] { return jBenchTarget_::new_(0, 0.0); }, [](jBenchTarget o) { o->fieldInt(0); }, 16, 16);
+        r.run("constructor/(int,double)", "pool", [&] {
+            auto o = pool.acquire();
+            o->fieldInt(1);
+            do_not_optimize(o.get());
+        });
+        r.run("constructor/(int,double)", "raw", [&] {
+            auto o = e->NewObject(f.clazz, id, 1, 2.0);
+            if (e->ExceptionCheck()) throw std::runtime_error("<init>");
+            do_not_optimize(o);
+            e->DeleteLocalRef(o);
+        });
+    }
+}
+
+//*************************************************************************************************
+// Accessing Fields
+//*************************************************************************************************
+void bench_field(runner& r, const fixture& f)
+{
+    auto e = f.env;
+    {
+        auto fld = uc::jni::make_field<jBenchTarget, jint>("fieldInt");
+        auto id = e->GetFieldID(f.clazz, "fieldInt", "I");
+        r.run("field/get int", "uc-jni", [&] {
+            do_not_optimize(fld.get(f.obj));
+        });
+        r.run("field/get int", "env", [&] {
+            do_not_optimize(fld.get(e, f.obj));
+        });
+        r.run("field/get int", "macro", [&] {
+            do_not_optimize(static_cast<jBenchTarget>(f.obj)->fieldInt());
+        });
+        r.run("field/get int", "raw", [&] {
+            do_not_optimize(e->GetIntField(f.obj, id));
+        });
+        r.run("field/set int", "uc-jni", [&] {
+            fld.set(f.obj, 1);
+        });
+        r.run("field/set int", "env", [&] {
+            fld.set(e, f.obj, 1);
+        });
+        r.run("field/set int", "raw", [&] {
+            e->SetIntField(f.obj, id, 1);
+        });
+    }
+    {
+        // the returned local reference is adopted, not duplicated with NewLocalRef.
+        auto fld = uc::jni::make_field<jBenchTarget, jstring>("fieldString");
+        auto id = e->GetFieldID(f.clazz, "fieldString", "Ljava/lang/String;");
+        r.run("field/get String", "uc-jni", [&] {
+            auto s = fld.get(f.obj);
+            do_not_optimize(s.get());
+        });
+        r.run("field/get String", "raw", [&] {
+            auto s = e->GetObjectField(f.obj, id);
+            do_not_optimize(s);
+            e->DeleteLocalRef(s);
+        });
+    }
+    {
+        auto fld = uc::jni::make_field<jBenchTarget, std::string>("fieldString");
+        auto id = e->GetFieldID(f.clazz, "fieldString", "Ljava/lang/String;");
+        r.run("field/get String->std::string", "uc-jni", [&] {
+            do_not_optimize(fld.get(f.obj));
+        });
+        r.run("field/get String->std::string", "raw", [&] {
+            auto s = static_cast<jstring>(e->GetObjectField(f.obj, id));
+            std::string ret(e->GetStringUTFLength(s), 0);
+            e->GetStringUTFRegion(s, 0, e->GetStringLength(s), &ret[0]);
+            e->DeleteLocalRef(s);
+            do_not_optimize(ret);
+        });
+    }
+    {
+        auto fld = uc::jni::make_static_field<jBenchTarget, jint>("staticFieldInt");
+        auto id = e->GetStaticFieldID(f.clazz, "staticFieldInt", "I");
+        r.run("static_field/get int", "uc-jni", [&] {
+            do_not_optimize(fld.get());
+        });
+        r.run("static_field/get int", "env", [&] {
+            do_not_optimize(fld.get(e));
+        });
+        r.run("static_field/get int", "raw", [&] {
+            do_not_optimize(e->GetStaticIntField(f.clazz, id));
+        });
+    }
+}
+
+//*************************************************************************************************
+// String Operations
+//*************************************************************************************************
+void bench_string(runner& r, const fixture& f)
+{
+    auto e = f.env;
+    const std::string shortStr = "Hello World!";
+    const std::string longStr(1024, 'x');
+    const std::u16string shortStr16 = u"Hello World!";
+
+    for (auto str : { &shortStr, &longStr }) {
+        const auto suffix = std::string(str == &shortStr ? " (12)" : " (1024)");
+        auto jstr = uc::jni::to_jstring(*str);
+
+        r.run(("to_jstring" + suffix).c_str(), "uc-jni", [&] {
+            auto s = uc::jni::to_jstring(*str);
+            do_not_optimize(s.get());
+        });
+        r.run(("to_jstring" + suffix).c_str(), "raw", [&] {
+            auto s = e->NewStringUTF(str->c_str());
+            do_not_optimize(s);
+            e->DeleteLocalRef(s);
+        });
+        r.run(("to_string" + suffix).c_str(), "uc-jni", [&] {
+            do_not_optimize(uc::jni::to_string(jstr));
+        });
+        // repeated conversions of the same jstring served from an identity_map (hash computed once).
+        uc::jni::identity_map<jstring, std::shared_ptr<const std::string>> memo;
+        const auto hash = uc::jni::identity_hash(jstr);
+        r.run(("to_string" + suffix).c_str(), "memo", [&] {
+            do_not_optimize(memo.get_or_insert(hash, jstr, [&] { return std::make_shared<const std::string>(uc::jni::to_string(jstr)); }));
+        });
+        r.run(("to_string" + suffix).c_str(), "raw", [&] {
+            std::string ret(e->GetStringUTFLength(jstr.get()), 0);
+            e->GetStringUTFRegion(jstr.get(), 0, e->GetStringLength(jstr.get()), &ret[0]);
+            do_not_optimize(ret);
+        });
+        r.run(("to_string(GetStringUTFChars)" + suffix).c_str(), "raw", [&] {
+            auto chars = e->GetStringUTFChars(jstr.get(), nullptr);
+            std::string ret(chars, e->GetStringUTFLength(jstr.get()));
+            e->ReleaseStringUTFChars(jstr.get(), chars);
+            do_not_optimize(ret);
+        });
+    }
+    {
+        auto jstr = uc::jni::to_jstring(shortStr16);
+        r.run("to_jstring u16 (12)", "uc-jni", [&] {
+            auto s = uc::jni::to_jstring(shortStr16);
+            do_not_optimize(s.get());
+        });
+        r.run("to_jstring u16 (12)", "raw", [&] {
+            auto s = e->NewString(reinterpret_cast<const jchar*>(shortStr16.data()), static_cast<jsize>(shortStr16.size()));
+            do_not_optimize(s);
+            e->DeleteLocalRef(s);
+        });
+        r.run("to_u16string (12)", "uc-jni", [&] {
+            do_not_optimize(uc::jni::to_u16string(jstr));
+        });
+        r.run("to_u16string (12)", "raw", [&] {
+            std::u16string ret(e->GetStringLength(jstr.get()), 0);
+            e->GetStringRegion(jstr.get(), 0, static_cast<jsize>(ret.size()), reinterpret_cast<jchar*>(&ret[0]));
+            do_not_optimize(ret);
+        });
+        r.run("join (3)", "uc-jni", [&] {
+            auto s = uc::jni::join(jstr, ", ", shortStr);
+            do_not_optimize(s.get());
+        });
+    }
+}
+
+//*************************************************************************************************
+// Array Operations
+//*************************************************************************************************
+void bench_array(runner& r, const fixture& f)
+{
+    auto e = f.env;
+    for (std::size_t n : { 16, 4096 }) {
+        const auto suffix = " (" + std::to_string(n) + ")";
+        std::vector<jint> values(n);
+        std::iota(values.begin(), values.end(), 0);
+        auto jarr = uc::jni::to_jarray(values);
+        const auto len = static_cast<jsize>(n);
+
+        r.run(("to_jarray int" + suffix).c_str(), "uc-jni", [&] {
+            auto a = uc::jni::to_jarray(values);
+            do_not_optimize(a.get());
+        });
+        r.run(("to_jarray int" + suffix).c_str(), "raw", [&] {
+            auto a = e->NewIntArray(len);
+            e->SetIntArrayRegion(a, 0, len, values.data());
+            do_not_optimize(a);
+            e->DeleteLocalRef(a);
+        });
+        r.run(("to_vector int" + suffix).c_str(), "uc-jni", [&] {
+            do_not_optimize(uc::jni::to_vector(jarr));
+        });
+        r.run(("to_vector int" + suffix).c_str(), "raw", [&] {
+            std::vector<jint> ret(e->GetArrayLength(jarr.get()));
+            e->GetIntArrayRegion(jarr.get(), 0, static_cast<jsize>(ret.size()), ret.data());
+            do_not_optimize(ret);
+        });
+        r.run(("get_elements int" + suffix).c_str(), "uc-jni", [&] {
+            auto elems = uc::jni::get_const_elements(jarr);
+            do_not_optimize(std::accumulate(uc::jni::begin(elems), uc::jni::end(elems), 0));
+        });
+        r.run(("get_elements int" + suffix).c_str(), "raw", [&] {
+            auto elems = e->GetIntArrayElements(jarr.get(), nullptr);
+            do_not_optimize(std::accumulate(elems, elems + e->GetArrayLength(jarr.get()), 0));
+            e->ReleaseIntArrayElements(jarr.get(), elems, JNI_ABORT);
+        });
+    }
+    for (std::size_t n : { 16, 256 }) {
+        const auto suffix = " (" + std::to_string(n) + ")";
+        std::vector<std::string> values(n, "Hello World!");
+        auto jarr = uc::jni::to_jarray(values);
+        auto stringClass = uc::jni::get_class<jstring>();
+        const auto len = static_cast<jsize>(n);
+
+        r.run(("to_jarray String" + suffix).c_str(), "uc-jni", [&] {
+            auto a = uc::jni::to_jarray(values);
+            do_not_optimize(a.get());
+        });
+        r.run(("to_jarray String" + suffix).c_str(), "raw", [&] {
+            auto a = e->NewObjectArray(len, stringClass, nullptr);
+            for (jsize i = 0; i < len; ++i) {
+                auto s = e->NewStringUTF(values[i].c_str());
+                e->SetObjectArrayElement(a, i, s);
+                e->DeleteLocalRef(s);
+            }
+            do_not_optimize(a);
+            e->DeleteLocalRef(a);
+        });
+        r.run(("to_vector String" + suffix).c_str(), "uc-jni", [&] {
+            do_not_optimize(uc::jni::to_vector<std::string>(jarr));
+        });
+        r.run(("to_vector String" + suffix).c_str(), "raw", [&] {
+            const auto n = e->GetArrayLength(jarr.get());
+            std::vector<std::string> ret;
+            ret.reserve(n);
+            for (jsize i = 0; i < n; ++i) {
+                auto s = static_cast<jstring>(e->GetObjectArrayElement(jarr.get(), i));
+                std::string str(e->GetStringUTFLength(s), 0);
+                e->GetStringUTFRegion(s, 0, e->GetStringLength(s), &str[0]);
+                ret.push_back(std::move(str));
+                e->DeleteLocalRef(s);
+            }
+            do_not_optimize(ret);
+        });
+        // one adopted local reference per element; no NewLocalRef / DeleteLocalRef pair.
+        r.run(("to_vector local_ref<String>" + suffix).c_str(), "uc-jni", [&] {
+            auto v = uc::jni::to_vector<uc::jni::local_ref<jstring>>(jarr);
+            do_not_optimize(v.data());
+        });
+        r.run(("to_vector local_ref<String>" + suffix).c_str(), "raw", [&] {
+            const auto n = e->GetArrayLength(jarr.get());
+            std::vector<jobject> ret;
+            ret.reserve(n);
+            for (jsize i = 0; i < n; ++i) {
+                ret.push_back(e->GetObjectArrayElement(jarr.get(), i));
+            }
+            do_not_optimize(ret.data());
+            for (auto&& s : ret) e->DeleteLocalRef(s);
+        });
+    }
+}
+
+//*************************************************************************************************
+// References
+//*************************************************************************************************
+void bench_ref(runner& r, const fixture& f)
+{
+    auto e = f.env;
+    r.run("make_local", "uc-jni", [&] {
+        auto l = uc::jni::make_local(f.obj);
+        do_not_optimize(l.get());
+    });
+    r.run("make_local", "raw", [&] {
+        auto l = e->NewLocalRef(f.obj);
+        do_not_optimize(l);
+        e->DeleteLocalRef(l);
+    });
+    r.run("global_ref churn", "uc-jni", [&] {
+        auto g = uc::jni::make_global(f.obj);
+        do_not_optimize(g.get());
+    });
+    r.run("global_ref churn", "raw", [&] {
+        auto g = e->NewGlobalRef(f.obj);
+        do_not_optimize(g);
+        e->DeleteGlobalRef(g);
+    });
+    r.run("global_ref churn", "unique", [&] {
+        auto g = uc::jni::make_unique_global(f.obj);
+        do_not_optimize(g.get());
+    });
+    r.run("global_ref copy", "uc-jni", [&, g = uc::jni::make_global(f.obj)] {
+        auto copy = g;
+        do_not_optimize(copy.get());
+    });
+    r.run("global_ref copy", "confined", [&, g = uc::jni::make_confined_global(f.obj)] {
+        auto copy = g;
+        do_not_optimize(copy.get());
+    });
+    r.run("weak_ref churn", "uc-jni", [&] {
+        uc::jni::weak_ref<jobject> w(f.obj);
+        do_not_optimize(w);
+    });
+    r.run("weak_ref churn", "unique", [&] {
+        uc::jni::unique_weak_ref<jobject> w(f.obj);
+        do_not_optimize(w.get());
+    });
+    r.run("weak_ref churn", "raw", [&] {
+        auto w = e->NewWeakGlobalRef(f.obj);
+        do_not_optimize(w);
+        e->DeleteWeakGlobalRef(w);
+    });
+    {
+        uc::jni::weak_ref<jobject> w(f.obj);
+        auto rawWeak = e->NewWeakGlobalRef(f.obj);
+        r.run("weak_ref lock", "uc-jni", [&] {
+            auto l = w.lock();
+            do_not_optimize(l.get());
+        });
+        r.run("weak_ref lock", "raw", [&] {
+            auto l = e->NewLocalRef(rawWeak);
+            do_not_optimize(l);
+            e->DeleteLocalRef(l);
+        });
+        e->DeleteWeakGlobalRef(rawWeak);
+    }
+}
+
+//*************************************************************************************************
+// NIO
+//*************************************************************************************************
+void bench_direct_buffer(runner& r, const fixture& f)
+{
+    auto e = f.env;
+    r.run("new_direct_buffer int (1024)", "uc-jni", [&] {
+        auto buf = uc::jni::new_direct_buffer<jint>(1024);
+        do_not_optimize(buf.get());
+    });
+    r.run("new_direct_buffer int (1024)", "raw", [&] {
+        auto address = new jint[1024];
+        auto local = e->NewDirectByteBuffer(address, 1024 * sizeof(jint));
+        auto buf = e->NewGlobalRef(local);
+        e->DeleteLocalRef(local);
+        do_not_optimize(buf);
+        delete[] static_cast<jint*>(e->GetDirectBufferAddress(buf));
+        e->DeleteGlobalRef(buf);
+    });
+    {
+        auto buf = uc::jni::new_direct_buffer<jint>(1024);
+        r.run("direct_buffer address", "uc-jni", [&] {
+            do_not_optimize(uc::jni::address(buf));
+        });
+        r.run("direct_buffer address", "raw", [&] {
+            do_not_optimize(e->GetDirectBufferAddress(buf.get()));
+        });
+    }
+}
+
+//*************************************************************************************************
+// Ring Buffer
+//*************************************************************************************************
+void bench_ring_buffer(runner& r, const fixture& f)
+{
+    auto e = f.env;
+    const jbyte record[64] = {};
+    if (r.selected("upcall record (64B)")) {
+        // a Java thread drains the ring through SpscRingBuffer; the producer waits only when the ring is full.
+        uc::jni::spsc_ring ring(1 << 20);
+        auto start = e->GetStaticMethodID(f.clazz, "startRingConsumer", "(Ljava/nio/ByteBuffer;)V");
+        auto stop = e->GetStaticMethodID(f.clazz, "stopRingConsumer", "()J");
+        e->CallStaticVoidMethod(f.clazz, start, ring.buffer());
+        uc::jni::exception_check();
+        jlong written = 0;
+        r.run("upcall record (64B)", "uc-jni", [&] {
+            ring.write(record, sizeof(record));
+            written += sizeof(record);
+        });
+        const auto consumed = e->CallStaticLongMethod(f.clazz, stop);
+        uc::jni::exception_check();
+        if (consumed != written) throw std::runtime_error("spsc_ring: Java consumer lost records");
+    }
+    auto consume = e->GetStaticMethodID(f.clazz, "consume", "([B)V");
+    r.run("upcall record (64B)", "raw", [&] {
+        auto arr = e->NewByteArray(sizeof(record));
+        e->SetByteArrayRegion(arr, 0, sizeof(record), record);
+        e->CallStaticVoidMethod(f.clazz, consume, arr);
+        e->DeleteLocalRef(arr);
+    });
+}
+
+//*************************************************************************************************
+// Multi-threaded Scaling (--threads N)
+//*************************************************************************************************
+std::vector<uc::bench::scaling_result> bench_scaling(const uc::bench::options& opt, const fixture& f)
+{
+    const auto obj = uc::jni::make_global(f.obj);
+    const auto getInt = uc::jni::make_method<jBenchTarget, jint()>("getInt");
+    const auto fieldInt = uc::jni::make_field<jBenchTarget, jint>("fieldInt");
+    const auto objHash = uc::jni::identity_hash(obj.get());
+    uc::jni::thread_pool pool(opt.threads, "uc-jni-bench");
+    uc::jni::handle_table<jBenchTarget> handles;
+    uc::jni::peer_registry<std::uint64_t> peers;
+    const auto peerHandle = peers.add(std::make_shared<std::uint64_t>(42));
+
+    struct scenario
+    {
+        const char* name;
+        std::size_t ops;
+        std::function<void()> op;
+    };
+    const std::vector<scenario> scenarios {
+        // env() + get_class<T>() + method call + field access + string round trip.
+        { "mixed", opt.iterations, [&] {
+            do_not_optimize(uc::jni::env());
+            do_not_optimize(uc::jni::get_class<jBenchTarget>());
+            do_not_optimize(getInt(obj));
+            do_not_optimize(fieldInt.get(obj));
+            do_not_optimize(uc::jni::to_string(uc::jni::to_jstring("Hello World!")));
+        } },
+        // the function-local static guard of get_class<T>() and the ID slot of a wrapper macro.
+        { "static_guards", opt.iterations, [&] {
+            do_not_optimize(uc::jni::get_class<jBenchTarget>());
+            do_not_optimize(jBenchTarget_::add(1, 2));
+        } },
+        // runtime-name lookups hitting the shared class cache.
+        { "find_class", opt.iterations, [&] {
+            do_not_optimize(uc::jni::find_class(BENCH_TARGET_FQCN).get());
+        } },
+        // NewGlobalRef/DeleteGlobalRef plus shared_ptr refcount traffic.
+        { "make_global", opt.iterations, [&] {
+            auto g = uc::jni::make_global(obj);
+            auto copy = g;
+            do_not_optimize(copy.get());
+        } },
+        // the same object kept reachable through a shared slab handle table instead.
+        { "handle_table", opt.iterations, [&] {
+            const auto h = handles.add(obj);
+            do_not_optimize(handles.get(h).get());
+            handles.remove(h);
+        } },
+        // resolving a jlong peer handle kept in a Java field (all threads share one peer).
+        { "peer_lookup", opt.iterations, [&] {
+            do_not_optimize(peers.get(peerHandle).get());
+        } },
+        { "global_ref_copy", opt.iterations, [&] {
+            auto copy = obj;
+            do_not_optimize(copy.get());
+        } },
+        { "make_local", opt.iterations, [&] {
+            auto l = uc::jni::make_local(obj.get());
+            do_not_optimize(l.get());
+        } },
+        // readers of native state attached to one Java object: JVM monitor vs. shared identity lock.
+        { "synchronized", opt.iterations, [&] {
+            auto lock = uc::jni::synchronized(obj);
+            do_not_optimize(lock.get());
+        } },
+        { "identity_shared_lock", opt.iterations, [&] {
+            auto lock = uc::jni::identity_locks().shared(objHash);
+            do_not_optimize(lock.owns_lock());
+        } },
+        // short-lived native thread: AttachCurrentThread() in env(), DetachCurrentThread() at thread exit.
+        { "attach_detach", std::max<std::size_t>(opt.iterations / 100, 10), [] {
+            std::thread([] { do_not_optimize(uc::jni::env()); }).join();
+        } },
+        // the same work on a pre-attached uc::jni::thread_pool worker.
+        { "thread_pool_task", std::max<std::size_t>(opt.iterations / 100, 10), [&pool] {
+            pool.submit([] { do_not_optimize(uc::jni::env()); }).get();
+        } },
+    };
+
+    std::vector<uc::bench::scaling_result> results;
+    for (auto&& s : scenarios) {
+        if (!opt.filter.empty() && std::string(s.name).find(opt.filter) == std::string::npos) continue;
+        for (auto n : uc::bench::thread_counts(opt.threads)) {
+            results.push_back(uc::bench::run_scaling(s.name, n, s.ops, s.op));
+        }
+    }
+    return results;
+}
+
+}
+
+//*************************************************************************************************
+// main
+//*************************************************************************************************
+int main(int argc, char** argv)
+{
+    const auto opt = uc::bench::options::parse(argc, argv);
+    try {
+        auto env = uc::bench::create_java_vm(UC_JNI_BENCH_CLASSPATH);
+        // IDs of the wrapper macros are resolved here, not on the first measured call.
+        jBenchTarget_::resolve_ids();
+        auto obj = jBenchTarget_::new_(1, 2.0);
+        const fixture f { env, uc::jni::get_class<jBenchTarget>(), obj.get() };
+
+        const uc::bench::context_type context {
+            { "uc_jni_version", UC_JNI_VERSION },
+            { "java_version", uc::bench::system_property("java.version") },
+            { "java_vm_name", uc::bench::system_property("java.vm.name") },
+            { "os_arch", uc::bench::system_property("os.arch") },
+            { "compiler", __VERSION__ },
+            { "hardware_concurrency", std::to_string(std::thread::hardware_concurrency()) },
+        };
+        std::ofstream ofs;
+        if (!opt.output.empty()) ofs.open(opt.output);
+        std::ostream& os = opt.output.empty() ? std::cout : ofs;
+
+        if (opt.threads > 0) {
+            uc::bench::write_scaling_json(os, context, bench_scaling(opt, f));
+            return 0;
+        }
+
+        runner r(env, opt);
+        bench_class(r, f);
+        bench_method(r, f);
+        bench_field(r, f);
+        bench_string(r, f);
+        bench_array(r, f);
+        bench_ref(r, f);
+        bench_direct_buffer(r, f);
+        bench_ring_buffer(r, f);
+        r.write_json(os, context);
+    } catch (std::exception& ex) {
+        std::cerr << "uc-jni-bench: " << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
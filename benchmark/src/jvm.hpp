@@ -0,0 +1,56 @@
+/**
+uc::jni <https://github.com/uctakeoff/uc-jni>
+Copyright (c) 2018, Kentaro Ushiyama
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+#ifndef UC_JNI_BENCH_JVM_HPP
+#define UC_JNI_BENCH_JVM_HPP
+#include "../../uc-jni.hpp"
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace uc {
+namespace bench {
+
+//*************************************************************************************************
+// In-process JavaVM
+//*************************************************************************************************
+
+//! start an in-process JavaVM through JNI_CreateJavaVM() and register it with uc::jni::java_vm().
+//! the calling thread is attached by JNI_CreateJavaVM() itself.
+inline JNIEnv* create_java_vm(const std::string& classpath, std::vector<std::string> extraOptions = {})
+{
+    std::vector<std::string> optionStrings { "-Djava.class.path=" + classpath, "-Xss8m" };
+    optionStrings.insert(optionStrings.end(), extraOptions.begin(), extraOptions.end());
+
+    std::vector<JavaVMOption> options;
+    for (auto&& s : optionStrings) {
+        options.push_back(JavaVMOption{ const_cast<char*>(s.c_str()), nullptr });
+    }
+    JavaVMInitArgs args {};
+    args.version = JNI_VERSION_1_8;
+    args.nOptions = static_cast<jint>(options.size());
+    args.options = options.data();
+    args.ignoreUnrecognized = JNI_FALSE;
+
+    JavaVM* vm{};
+    JNIEnv* env{};
+    if (JNI_CreateJavaVM(&vm, reinterpret_cast<void**>(&env), &args) != JNI_OK) {
+        throw std::runtime_error("JNI_CreateJavaVM failed");
+    }
+    uc::jni::java_vm(vm);
+    return env;
+}
+
+inline std::string system_property(const char* key)
+{
+    UC_JNI_DEFINE_JCLASS_ALIAS(System, java/lang/System);
+    static auto getProperty = uc::jni::make_static_method<System, std::string(std::string)>("getProperty");
+    return getProperty(std::string(key));
+}
+
+}
+}
+#endif
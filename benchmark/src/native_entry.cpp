@@ -0,0 +1,67 @@
+/**
+uc::jni <https://github.com/uctakeoff/uc-jni>
+Copyright (c) 2018, Kentaro Ushiyama
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+// Native side of the JMH entry cost benchmark (benchmark/jmh).
+// Every entry has the same trivial body and differs only in how it is bound and guarded.
+#include "../../uc-jni.hpp"
+
+#define JNI(ret, name) extern "C" JNIEXPORT ret JNICALL Java_com_example_uc_ucjnibench_NativeEntry_ ## name
+
+UC_JNI_DEFINE_JCLASS_ALIAS(NativeEntry, com/example/uc/ucjnibench/NativeEntry);
+
+//*************************************************************************************************
+// Entries
+//*************************************************************************************************
+// exported        : JNI(...) symbol export, no guard
+// exportedGuarded : JNI(...) symbol export, body wrapped with uc::jni::exception_guard()
+// registered      : bound by uc::jni::register_natives(), no guard
+// registeredGuarded : bound by uc::jni::register_natives(), body wrapped with uc::jni::exception_guard()
+#define DEFINE_ENTRIES(suffix, body, ...) \
+JNI(jint, exported ## suffix)(JNIEnv*, jobject, ##__VA_ARGS__) { return body; }\
+JNI(jint, exportedGuarded ## suffix)(JNIEnv*, jobject, ##__VA_ARGS__) { return uc::jni::exception_guard([&] { return body; }); }\
+static jint registered ## suffix(JNIEnv*, jobject, ##__VA_ARGS__) { return body; }\
+static jint registeredGuarded ## suffix(JNIEnv*, jobject, ##__VA_ARGS__) { return uc::jni::exception_guard([&] { return body; }); }
+
+#define NN(a) (a != nullptr)
+
+DEFINE_ENTRIES(0,  0)
+DEFINE_ENTRIES(I1, a0, jint a0)
+DEFINE_ENTRIES(I2, a0 + a1, jint a0, jint a1)
+DEFINE_ENTRIES(I4, a0 + a1 + a2 + a3, jint a0, jint a1, jint a2, jint a3)
+DEFINE_ENTRIES(I8, a0 + a1 + a2 + a3 + a4 + a5 + a6 + a7, jint a0, jint a1, jint a2, jint a3, jint a4, jint a5, jint a6, jint a7)
+DEFINE_ENTRIES(L1, NN(a0), jobject a0)
+DEFINE_ENTRIES(L2, NN(a0) + NN(a1), jobject a0, jobject a1)
+DEFINE_ENTRIES(L4, NN(a0) + NN(a1) + NN(a2) + NN(a3), jobject a0, jobject a1, jobject a2, jobject a3)
+DEFINE_ENTRIES(L8, NN(a0) + NN(a1) + NN(a2) + NN(a3) + NN(a4) + NN(a5) + NN(a6) + NN(a7), jobject a0, jobject a1, jobject a2, jobject a3, jobject a4, jobject a5, jobject a6, jobject a7)
+
+#undef NN
+#undef DEFINE_ENTRIES
+
+//*************************************************************************************************
+// JNI_OnLoad
+//*************************************************************************************************
+#define REGISTERED_ENTRIES(suffix) \
+    uc::jni::make_native_method("registered" #suffix, &registered ## suffix),\
+    uc::jni::make_native_method("registeredGuarded" #suffix, &registeredGuarded ## suffix)
+
+extern "C" JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM* vm, void*)
+{
+    uc::jni::java_vm(vm);
+    return uc::jni::exception_guard([] {
+        const JNINativeMethod methods[] {
+            REGISTERED_ENTRIES(0),
+            REGISTERED_ENTRIES(I1),
+            REGISTERED_ENTRIES(I2),
+            REGISTERED_ENTRIES(I4),
+            REGISTERED_ENTRIES(I8),
+            REGISTERED_ENTRIES(L1),
+            REGISTERED_ENTRIES(L2),
+            REGISTERED_ENTRIES(L4),
+            REGISTERED_ENTRIES(L8),
+        };
+        return uc::jni::register_natives<NativeEntry>(methods) ? JNI_VERSION_1_6 : JNI_ERR;
+    });
+}
@@ -0,0 +1,137 @@
+/**
+uc::jni <https://github.com/uctakeoff/uc-jni>
+Copyright (c) 2018, Kentaro Ushiyama
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+#ifndef UC_JNI_BENCH_SCALING_HPP
+#define UC_JNI_BENCH_SCALING_HPP
+#include "../../uc-jni.hpp"
+#include "bench.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+namespace uc {
+namespace bench {
+
+//*************************************************************************************************
+// Multi-threaded Scaling
+//*************************************************************************************************
+
+struct scaling_result
+{
+    std::string scenario;
+    std::size_t threads;
+    std::size_t ops;
+    double seconds;
+    double ops_per_sec;
+    double p50_ns;
+    double p99_ns;
+    double p999_ns;
+};
+
+//! one-shot barrier (std::barrier is C++20).
+class start_barrier
+{
+public:
+    explicit start_barrier(std::size_t count) : count_(count)
+    {
+    }
+    void arrive_and_wait()
+    {
+        std::unique_lock<std::mutex> lk(mutex_);
+        if (--count_ == 0) {
+            cv_.notify_all();
+        } else {
+            cv_.wait(lk, [this] { return count_ == 0; });
+        }
+    }
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::size_t count_;
+};
+
+//! thread counts swept by the scaling mode: 1, 2, 4, ... maxThreads.
+inline std::vector<std::size_t> thread_counts(std::size_t maxThreads)
+{
+    std::vector<std::size_t> ret;
+    for (std::size_t n = 1; n < maxThreads; n *= 2) {
+        ret.push_back(n);
+    }
+    ret.push_back(maxThreads);
+    return ret;
+}
+
+//! run "op" opsPerThread times on each of "threads" native threads and measure every call.
+//! threads attach through uc::jni::env() before the clock starts; local references are released every "batch" ops.
+template <typename Op> scaling_result run_scaling(const char* scenario, std::size_t threads, std::size_t opsPerThread, Op&& op)
+{
+    using clock_type = std::chrono::steady_clock;
+    constexpr std::size_t batch = 256;
+
+    std::vector<std::vector<std::uint32_t>> latencies(threads);
+    start_barrier ready(threads + 1);
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            auto e = uc::jni::env();
+            auto& lat = latencies[t];
+            lat.reserve(opsPerThread);
+            ready.arrive_and_wait();
+            for (std::size_t i = 0; i < opsPerThread; i += batch) {
+                e->PushLocalFrame(16);
+                for (std::size_t j = i, je = std::min(i + batch, opsPerThread); j < je; ++j) {
+                    const auto start = clock_type::now();
+                    op();
+                    const auto end = clock_type::now();
+                    lat.push_back(static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+                }
+                e->PopLocalFrame(nullptr);
+            }
+        });
+    }
+    ready.arrive_and_wait();
+    const auto start = clock_type::now();
+    for (auto&& w : workers) {
+        w.join();
+    }
+    const auto seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+
+    std::vector<std::uint32_t> all;
+    all.reserve(threads * opsPerThread);
+    for (auto&& lat : latencies) {
+        all.insert(all.end(), lat.begin(), lat.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&](double p) -> double {
+        return all.empty() ? 0.0 : all[std::min(all.size() - 1, static_cast<std::size_t>(p * all.size()))];
+    };
+    const auto ops = all.size();
+    scaling_result ret { scenario, threads, ops, seconds, ops / seconds, percentile(0.5), percentile(0.99), percentile(0.999) };
+
+    std::fprintf(stderr, "%-24s %3zu threads %14.0f ops/s  p50 %8.0f  p99 %8.0f  p999 %8.0f ns\n",
+        scenario, threads, ret.ops_per_sec, ret.p50_ns, ret.p99_ns, ret.p999_ns);
+    return ret;
+}
+
+inline void write_scaling_json(std::ostream& os, const context_type& context, const std::vector<scaling_result>& results)
+{
+    os << "{\n";
+    write_json_context(os, context);
+    os << ",\n  \"scaling\": [";
+    const char* sep = "\n";
+    for (auto&& r : results) {
+        os << sep << "    {\"scenario\": \"" << json_escape(r.scenario) << "\", \"threads\": " << r.threads
+           << ", \"ops\": " << r.ops << ", \"seconds\": " << r.seconds << ", \"ops_per_sec\": " << r.ops_per_sec
+           << ", \"p50_ns\": " << r.p50_ns << ", \"p99_ns\": " << r.p99_ns << ", \"p999_ns\": " << r.p999_ns << "}";
+        sep = ",\n";
+    }
+    os << "\n  ]\n}\n";
+}
+
+}
+}
+#endif
@@ -16,6 +16,96 @@ http://opensource.org/licenses/mit-license.php
 #include <type_traits>
 #include <vector>
 #include <algorithm>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#ifdef UC_JNI_ENABLE_METRICS
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <new>
+#endif
+#ifdef UC_JNI_ENABLE_TRACE
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#endif
+#ifdef UC_JNI_ENABLE_REF_STATS
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#endif
+#ifdef UC_JNI_ENABLE_COPY_STATS
+#include <atomic>
+#include <cstdint>
+#endif
+#ifdef UC_JNI_ENABLE_ALLOC_AUDIT
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#endif
+#ifdef UC_JNI_ENABLE_RING_BUFFER
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#endif
+#ifdef UC_JNI_ENABLE_HANDLE_TABLE
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#endif
+#ifdef UC_JNI_ENABLE_PEER_REGISTRY
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#endif
+#ifdef UC_JNI_ENABLE_UPCALL_CHANNEL
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <tuple>
+#endif
+#ifdef __cpp_impl_coroutine
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#endif
+#ifdef UC_JNI_ENABLE_THREAD_POOL
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#endif
+#ifdef UC_JNI_ENABLE_IDENTITY_LOCKS
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <shared_mutex>
+#endif
+#ifdef UC_JNI_ENABLE_IDENTITY_MAP
+#include <algorithm>
+#include <cstdint>
+#include <shared_mutex>
+#include <unordered_map>
+#endif
 
 namespace uc {
 namespace jni {
@@ -62,29 +152,574 @@ inline JavaVM* java_vm(JavaVM* init = nullptr) noexcept
 // JNIEnv
 //*************************************************************************************************
 
+namespace internal
+{
+    //! converts to JNIEnv** (Android) or void** (OpenJDK) for AttachCurrentThread().
+    struct env_out
+    {
+        operator JNIEnv**() const noexcept { return p; }
+        operator void**() const noexcept { return reinterpret_cast<void**>(p); }
+        JNIEnv** p;
+    };
+    struct thread_env
+    {
+        ~thread_env()
+        {
+            if (attached) java_vm()->DetachCurrentThread();
+        }
+        JNIEnv* env{};
+        bool attached{};
+    };
+    inline thread_env& this_thread_env() noexcept
+    {
+        thread_local thread_env instance {};
+        return instance;
+    }
+}
+
+//! attach the current thread as "name" unless it is already attached (then GetEnv() result is returned).
+//! a thread attached here is detached when it exits, or by detach_current_thread().
+inline JNIEnv* attach_current_thread(const char* name = nullptr, bool daemon = false, jobject group = nullptr) noexcept
+{
+    auto& t = internal::this_thread_env();
+    if (t.env) return t.env;
+    // only a thread attached here (or an env_scope) keeps its JNIEnv*. the owner of any other thread may detach and re-attach it.
+    const auto vm = java_vm();
+    JNIEnv* e{};
+    if (vm->GetEnv(reinterpret_cast<void**>(&e), JNI_VERSION_1_6) == JNI_OK) return e;
+    JavaVMAttachArgs args { JNI_VERSION_1_6, const_cast<char*>(name), group };
+    const auto result = daemon ? vm->AttachCurrentThreadAsDaemon(internal::env_out{ &e }, &args) : vm->AttachCurrentThread(internal::env_out{ &e }, &args);
+    if (result != JNI_OK) return nullptr;
+    t.env = e;
+    t.attached = true;
+    return t.env;
+}
+//! detach the current thread if attach_current_thread() or env() attached it. threads owned by the JVM are left alone.
+inline bool detach_current_thread() noexcept
+{
+    auto& t = internal::this_thread_env();
+    if (!t.attached) return false;
+    java_vm()->DetachCurrentThread();
+    t.env = nullptr;
+    t.attached = false;
+    return true;
+}
+//! JNIEnv* of the current thread. cached for threads uc-jni attached and inside env_scope; asks GetEnv() elsewhere.
 inline JNIEnv* env() noexcept
 {
-    struct vm_attacher
+    const auto e = internal::this_thread_env().env;
+    return e ? e : attach_current_thread();
+}
+//! caches the JNIEnv* a native method received until the scope ends, so env() needs no GetEnv() during the call.
+//! it has no effect on threads uc-jni attached.
+class env_scope
+{
+public:
+    explicit env_scope(JNIEnv* e) noexcept : thread_(internal::this_thread_env()), previous_(thread_.env), seeded_(!thread_.attached)
+    {
+        if (seeded_) thread_.env = e;
+    }
+    ~env_scope()
+    {
+        if (seeded_) thread_.env = previous_;
+    }
+    env_scope(const env_scope&) = delete;
+    env_scope& operator=(const env_scope&) = delete;
+
+private:
+    internal::thread_env& thread_;
+    JNIEnv* previous_;
+    bool seeded_;
+};
+
+//*************************************************************************************************
+// Allocation Audit (define UC_JNI_ENABLE_ALLOC_AUDIT)
+//*************************************************************************************************
+#ifdef UC_JNI_ENABLE_ALLOC_AUDIT
+namespace alloc_audit
+{
+    //! operator new calls made by the current thread. counted by UC_JNI_DEFINE_ALLOC_AUDIT_OPERATOR_NEW().
+    inline std::uint64_t& allocations() noexcept
     {
-        vm_attacher()
+        thread_local std::uint64_t count = 0;
+        return count;
+    }
+    //! number of operator new calls made by the current thread while running func.
+    template <typename F> std::uint64_t count(F&& func)
+    {
+        const auto start = allocations();
+        func();
+        return allocations() - start;
+    }
+}
+#ifdef __cpp_aligned_new
+#define UC_JNI_DEFINE_ALLOC_AUDIT_ALIGNED_OPERATOR_NEW_() \
+    void* operator new(std::size_t size, std::align_val_t al)\
+    {\
+        ++uc::jni::alloc_audit::allocations();\
+        void* p = nullptr;\
+        if (posix_memalign(&p, std::max(static_cast<std::size_t>(al), sizeof(void*)), size ? size : 1) == 0) return p;\
+        throw std::bad_alloc();\
+    }\
+    void* operator new(std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept\
+    {\
+        ++uc::jni::alloc_audit::allocations();\
+        void* p = nullptr;\
+        return posix_memalign(&p, std::max(static_cast<std::size_t>(al), sizeof(void*)), size ? size : 1) == 0 ? p : nullptr;\
+    }\
+    void* operator new[](std::size_t size, std::align_val_t al) { return ::operator new(size, al); }\
+    void* operator new[](std::size_t size, std::align_val_t al, const std::nothrow_t& t) noexcept { return ::operator new(size, al, t); }\
+    void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }\
+    void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }\
+    void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }\
+    void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }\
+    void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }\
+    void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+#else
+#define UC_JNI_DEFINE_ALLOC_AUDIT_ALIGNED_OPERATOR_NEW_()
+#endif
+//! replace the global operator new/delete, including the aligned overloads (C++17). use it once at namespace scope in one translation unit.
+#define UC_JNI_DEFINE_ALLOC_AUDIT_OPERATOR_NEW() \
+    void* operator new(std::size_t size)\
+    {\
+        ++uc::jni::alloc_audit::allocations();\
+        if (auto p = std::malloc(size ? size : 1)) return p;\
+        throw std::bad_alloc();\
+    }\
+    void* operator new(std::size_t size, const std::nothrow_t&) noexcept\
+    {\
+        ++uc::jni::alloc_audit::allocations();\
+        return std::malloc(size ? size : 1);\
+    }\
+    void* operator new[](std::size_t size) { return ::operator new(size); }\
+    void* operator new[](std::size_t size, const std::nothrow_t& t) noexcept { return ::operator new(size, t); }\
+    void operator delete(void* p) noexcept { std::free(p); }\
+    void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }\
+    void operator delete(void* p, std::size_t) noexcept { std::free(p); }\
+    void operator delete[](void* p) noexcept { std::free(p); }\
+    void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }\
+    void operator delete[](void* p, std::size_t) noexcept { std::free(p); }\
+    UC_JNI_DEFINE_ALLOC_AUDIT_ALIGNED_OPERATOR_NEW_()
+#endif
+
+//*************************************************************************************************
+// Tracing (define UC_JNI_ENABLE_TRACE)
+//*************************************************************************************************
+#ifdef UC_JNI_ENABLE_TRACE
+#ifndef UC_JNI_TRACE_BUFFER_SIZE
+#define UC_JNI_TRACE_BUFFER_SIZE 8192
+#endif
+namespace internal
+{
+    //! one complete ("X") event. strings must have static storage duration.
+    struct trace_event
+    {
+        const char* name;
+        const char* category;
+        const char* detail;
+        std::int64_t begin_ns;
+        std::int64_t duration_ns;
+    };
+
+    //! per-thread ring buffer. the mutex is only contended while write_json() or clear() runs.
+    struct trace_buffer
+    {
+        explicit trace_buffer(std::uint32_t tid) : tid(tid), events(UC_JNI_TRACE_BUFFER_SIZE)
         {
-            java_vm()->AttachCurrentThread(&env, nullptr);
         }
-        ~vm_attacher()
+        void push(const trace_event& ev) noexcept
         {
-            java_vm()->DetachCurrentThread();
+            std::lock_guard<std::mutex> lock(mutex);
+            events[head] = ev;
+            head = (head + 1) % events.size();
+            count = std::min(count + 1, events.size());
         }
-        JNIEnv* env{};
+
+        std::mutex mutex;
+        const std::uint32_t tid;
+        std::string thread_name;
+        bool alive = true;
+        std::vector<trace_event> events;
+        size_t head = 0;
+        size_t count = 0;
+    };
+
+    inline std::int64_t trace_now() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    inline void trace_write_string(std::ostream& os, const char* str)
+    {
+        os << '"';
+        for (; *str; ++str) {
+            const auto c = static_cast<unsigned char>(*str);
+            if (c < 0x20) {
+                // JSON strings cannot hold raw control characters.
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                os << buf;
+            } else {
+                if (c == '"' || c == '\\') os << '\\';
+                os << *str;
+            }
+        }
+        os << '"';
+    }
+    inline void trace_write_us(std::ostream& os, std::int64_t ns)
+    {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%lld.%03d", static_cast<long long>(ns / 1000), static_cast<int>(ns % 1000));
+        os << buf;
+    }
+
+    class trace_registry
+    {
+    public:
+        static trace_registry& instance()
+        {
+            // never destroyed: thread_local buffers of other threads may outlive static destruction.
+            static auto singleton = new trace_registry();
+            return *singleton;
+        }
+        std::shared_ptr<trace_buffer> attach()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            buffers.push_back(std::make_shared<trace_buffer>(++last_tid));
+            return buffers.back();
+        }
+        //! Chrome trace event format. Load it in chrome://tracing or ui.perfetto.dev.
+        void write_json(std::ostream& os)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            os << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+            const char* sep = "\n";
+            for (auto&& b : buffers) {
+                std::lock_guard<std::mutex> bufferLock(b->mutex);
+                if (!b->thread_name.empty()) {
+                    os << sep << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << b->tid << ", \"args\": {\"name\": ";
+                    trace_write_string(os, b->thread_name.c_str());
+                    os << "}}";
+                    sep = ",\n";
+                }
+                const auto size = b->events.size();
+                for (size_t i = 0; i < b->count; ++i) {
+                    const auto& ev = b->events[(b->head + size - b->count + i) % size];
+                    os << sep << "{\"name\": ";
+                    trace_write_string(os, ev.name);
+                    os << ", \"cat\": ";
+                    trace_write_string(os, ev.category);
+                    os << ", \"ph\": \"X\", \"ts\": ";
+                    trace_write_us(os, ev.begin_ns);
+                    os << ", \"dur\": ";
+                    trace_write_us(os, ev.duration_ns);
+                    os << ", \"pid\": 1, \"tid\": " << b->tid;
+                    if (ev.detail) {
+                        os << ", \"args\": {\"detail\": ";
+                        trace_write_string(os, ev.detail);
+                        os << "}";
+                    }
+                    os << "}";
+                    sep = ",\n";
+                }
+            }
+            os << "\n]}\n";
+        }
+        //! drop recorded events and the buffers of exited threads.
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            buffers.erase(std::remove_if(buffers.begin(), buffers.end(), [](auto&& b) {
+                std::lock_guard<std::mutex> bufferLock(b->mutex);
+                b->head = b->count = 0;
+                return !b->alive;
+            }), buffers.end());
+        }
+    private:
+        trace_registry() = default;
+
+        std::mutex mutex;
+        std::vector<std::shared_ptr<trace_buffer>> buffers;
+        std::uint32_t last_tid = 0;
+    };
+
+    inline trace_buffer& this_thread_trace_buffer()
+    {
+        struct holder
+        {
+            ~holder()
+            {
+                std::lock_guard<std::mutex> lock(buffer->mutex);
+                buffer->alive = false;
+            }
+            std::shared_ptr<trace_buffer> buffer = trace_registry::instance().attach();
+        };
+        thread_local holder instance;
+        return *instance.buffer;
+    }
+}
+
+namespace trace
+{
+    //! record [construction, destruction) as one event of the current thread.
+    class scope
+    {
+    public:
+        scope(const char* name, const char* category, const char* detail = nullptr) noexcept
+            : name(name), category(category), detail(detail), begin(internal::trace_now())
+        {
+        }
+        ~scope()
+        {
+            internal::this_thread_trace_buffer().push(internal::trace_event{ name, category, detail, begin, internal::trace_now() - begin });
+        }
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+    private:
+        const char* name;
+        const char* category;
+        const char* detail;
+        std::int64_t begin;
     };
-    thread_local vm_attacher instance {};
-    return instance.env;
+
+    inline void set_thread_name(const std::string& name)
+    {
+        auto& b = internal::this_thread_trace_buffer();
+        std::lock_guard<std::mutex> lock(b.mutex);
+        b.thread_name = name;
+    }
+    inline void write_json(std::ostream& os)
+    {
+        internal::trace_registry::instance().write_json(os);
+    }
+    inline bool write_json(const std::string& path)
+    {
+        std::ofstream ofs(path);
+        write_json(ofs);
+        return static_cast<bool>(ofs);
+    }
+    inline void clear()
+    {
+        internal::trace_registry::instance().clear();
+    }
 }
+#define UC_JNI_TRACE_SCOPE(name, category, detail) uc::jni::trace::scope uc_jni_trace_scope_{ name, category, detail };
+#else
+#define UC_JNI_TRACE_SCOPE(name, category, detail)
+#endif
 
 //*************************************************************************************************
 // C++ Exception
 //*************************************************************************************************
 
 void exception_check();
+void exception_check(JNIEnv* e);
+
+//*************************************************************************************************
+// Reference Statistics (define UC_JNI_ENABLE_REF_STATS)
+//*************************************************************************************************
+#ifdef UC_JNI_ENABLE_REF_STATS
+namespace ref_stats
+{
+    //! local references owned through local_ref on one thread.
+    struct local_stats
+    {
+        std::uint32_t thread;   //!< 1, 2, ... in order of first use
+        std::int64_t current;   //!< adopted - deleted
+        std::int64_t peak;      //!< high-water mark of "current" since the last reset_local_peak()
+        std::uint64_t adopted;
+        std::uint64_t deleted;  //!< deleted by local_ref, or handed over by release_local()
+    };
+    //! global_ref / weak_ref per JType.
+    struct global_stats
+    {
+        std::string type;
+        std::int64_t live_global;
+        std::int64_t peak_global;
+        std::int64_t live_weak;
+        std::int64_t peak_weak;
+    };
+}
+
+namespace internal
+{
+    //! written only by the owning thread.
+    struct ref_stats_thread
+    {
+        explicit ref_stats_thread(std::uint32_t index) noexcept : index(index)
+        {
+        }
+        void adopt() noexcept
+        {
+            adopted.store(adopted.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            const auto n = current.load(std::memory_order_relaxed) + 1;
+            current.store(n, std::memory_order_relaxed);
+            if (n > peak.load(std::memory_order_relaxed)) peak.store(n, std::memory_order_relaxed);
+        }
+        void remove() noexcept
+        {
+            deleted.store(deleted.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            current.store(current.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        }
+        ref_stats::local_stats get() const noexcept
+        {
+            return ref_stats::local_stats{ index, current.load(std::memory_order_relaxed), peak.load(std::memory_order_relaxed),
+                adopted.load(std::memory_order_relaxed), deleted.load(std::memory_order_relaxed) };
+        }
+
+        const std::uint32_t index;
+        std::atomic<std::int64_t> current{};
+        std::atomic<std::int64_t> peak{};
+        std::atomic<std::uint64_t> adopted{};
+        std::atomic<std::uint64_t> deleted{};
+    };
+
+    struct ref_type_counter
+    {
+        explicit ref_type_counter(std::string type) : type(std::move(type))
+        {
+        }
+        static void increment(std::atomic<std::int64_t>& live, std::atomic<std::int64_t>& peak) noexcept
+        {
+            const auto n = live.fetch_add(1, std::memory_order_relaxed) + 1;
+            auto p = peak.load(std::memory_order_relaxed);
+            while (n > p && !peak.compare_exchange_weak(p, n, std::memory_order_relaxed)) {}
+        }
+        void new_global() noexcept { increment(global, global_peak); }
+        void delete_global() noexcept { global.fetch_sub(1, std::memory_order_relaxed); }
+        void new_weak() noexcept { increment(weak, weak_peak); }
+        void delete_weak() noexcept { weak.fetch_sub(1, std::memory_order_relaxed); }
+
+        const std::string type;
+        std::atomic<std::int64_t> global{};
+        std::atomic<std::int64_t> global_peak{};
+        std::atomic<std::int64_t> weak{};
+        std::atomic<std::int64_t> weak_peak{};
+    };
+
+    class ref_stats_registry
+    {
+    public:
+        static ref_stats_registry& instance()
+        {
+            // never destroyed: thread_local counters of other threads may outlive static destruction.
+            static auto singleton = new ref_stats_registry();
+            return *singleton;
+        }
+        ref_stats_thread* attach()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            threads.push_back(new ref_stats_thread(++last_index));
+            return threads.back();
+        }
+        void detach(ref_stats_thread* t)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            threads.erase(std::find(threads.begin(), threads.end(), t));
+            delete t;
+        }
+        ref_type_counter& add_type(std::string type)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            types.emplace_back(std::move(type));
+            return types.back();
+        }
+        std::vector<ref_stats::local_stats> locals()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<ref_stats::local_stats> ret;
+            for (auto t : threads) {
+                ret.push_back(t->get());
+            }
+            return ret;
+        }
+        std::vector<ref_stats::global_stats> globals()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<ref_stats::global_stats> ret;
+            for (auto&& t : types) {
+                ret.push_back(ref_stats::global_stats{ t.type, t.global.load(std::memory_order_relaxed), t.global_peak.load(std::memory_order_relaxed),
+                    t.weak.load(std::memory_order_relaxed), t.weak_peak.load(std::memory_order_relaxed) });
+            }
+            return ret;
+        }
+    private:
+        ref_stats_registry() = default;
+
+        std::mutex mutex;
+        std::vector<ref_stats_thread*> threads;
+        std::deque<ref_type_counter> types;
+        std::uint32_t last_index = 0;
+    };
+
+    inline ref_stats_thread& this_thread_ref_stats()
+    {
+        struct holder
+        {
+            ~holder()
+            {
+                ref_stats_registry::instance().detach(stats);
+            }
+            ref_stats_thread* stats = ref_stats_registry::instance().attach();
+        };
+        thread_local holder instance;
+        return *instance.stats;
+    }
+
+    //! "_jstring*", "jPoint_*", ... from the compiler's function signature.
+    template <typename T> std::string ref_type_name()
+    {
+#if defined(__GNUC__)
+        const std::string name = __PRETTY_FUNCTION__;
+        const auto first = name.find("T = ");
+        if (first == std::string::npos) return name;
+        const auto last = name.find_first_of(";]", first);
+        return name.substr(first + 4, last - first - 4);
+#else
+        return "unknown";
+#endif
+    }
+    template <typename T> ref_type_counter& ref_counter()
+    {
+        static auto& instance = ref_stats_registry::instance().add_type(ref_type_name<T>());
+        return instance;
+    }
+}
+
+namespace ref_stats
+{
+    //! local references of the current thread.
+    inline local_stats local() noexcept
+    {
+        return internal::this_thread_ref_stats().get();
+    }
+    inline void reset_local_peak() noexcept
+    {
+        auto& t = internal::this_thread_ref_stats();
+        t.peak.store(t.current.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    //! local references of all running threads.
+    inline std::vector<local_stats> locals()
+    {
+        return internal::ref_stats_registry::instance().locals();
+    }
+    inline std::vector<global_stats> globals()
+    {
+        return internal::ref_stats_registry::instance().globals();
+    }
+    inline void dump(std::ostream& os)
+    {
+        for (auto&& s : locals()) {
+            os << "local  thread #" << s.thread << " : current " << s.current << ", peak " << s.peak << ", adopted " << s.adopted << ", deleted " << s.deleted << "\n";
+        }
+        for (auto&& s : globals()) {
+            os << "global " << s.type << " : live " << s.live_global << " (peak " << s.peak_global << "), weak " << s.live_weak << " (peak " << s.peak_weak << ")\n";
+        }
+    }
+}
+#define UC_JNI_REF_STATS(...) __VA_ARGS__
+#else
+#define UC_JNI_REF_STATS(...)
+#endif
 
 //*************************************************************************************************
 // Global and Local References
@@ -113,13 +748,162 @@ template <typename JType> struct local_ref_deleter
 {
     void operator()(JType p) const noexcept
     {
+        UC_JNI_REF_STATS(internal::this_thread_ref_stats().remove();)
         env()->DeleteLocalRef(p);
     }
 };
 template <typename JType> using local_ref = std::unique_ptr<std::remove_pointer_t<JType>, local_ref_deleter<JType>>;
+static_assert(sizeof(local_ref<jobject>) == sizeof(jobject), "uc::jni::local_ref must stay pointer-sized");
+
+//! local_ref of the explicit JNIEnv* API: deletes with the JNIEnv* it was created with, without looking up env().
+template <typename JType> struct local_ref_in_deleter
+{
+    void operator()(JType p) const noexcept
+    {
+        UC_JNI_REF_STATS(internal::this_thread_ref_stats().remove();)
+        e->DeleteLocalRef(p);
+    }
+    JNIEnv* e;
+};
+template <typename JType> using local_ref_in = std::unique_ptr<std::remove_pointer_t<JType>, local_ref_in_deleter<JType>>;
+
+namespace internal
+{
+    //! take ownership of a local reference returned by JNI.
+    template <typename JType> local_ref<JType> adopt_local(JType obj) noexcept
+    {
+        UC_JNI_REF_STATS(if (obj) this_thread_ref_stats().adopt();)
+        return local_ref<JType>{ obj };
+    }
+    //! "e" only documents where obj came from; local_ref deletes with env().
+    template <typename JType> local_ref<JType> adopt_local(JNIEnv*, JType obj) noexcept
+    {
+        return adopt_local(obj);
+    }
+    template <typename JType> local_ref<JType> new_local(JNIEnv* e, JType obj) noexcept
+    {
+        return adopt_local(static_cast<JType>(e->NewLocalRef(obj)));
+    }
+
+    //! results of the explicit JNIEnv* overloads : local_ref becomes local_ref_in, anything else passes through.
+    template <typename T> T in_env(JNIEnv*, T&& result) noexcept
+    {
+        return std::forward<T>(result);
+    }
+    template <typename JType> local_ref_in<JType> in_env(JNIEnv* e, local_ref<JType>&& ref) noexcept
+    {
+        return local_ref_in<JType>{ ref.release(), local_ref_in_deleter<JType>{ e } };
+    }
+}
+//! hands the reference over without deleting it, e.g. as the return value of a native method.
+//! unlike local_ref::release(), Reference Statistics counts it as no longer owned.
+template <typename JType> JType release_local(local_ref<JType>& ref) noexcept
+{
+    UC_JNI_REF_STATS(if (ref) internal::this_thread_ref_stats().remove();)
+    return ref.release();
+}
+template <typename JType> JType release_local(local_ref<JType>&& ref) noexcept
+{
+    return release_local(ref);
+}
+template <typename JType> JType release_local(local_ref_in<JType>& ref) noexcept
+{
+    UC_JNI_REF_STATS(if (ref) internal::this_thread_ref_stats().remove();)
+    return ref.release();
+}
+template <typename JType> JType release_local(local_ref_in<JType>&& ref) noexcept
+{
+    return release_local(ref);
+}
 template <typename JType> local_ref<JType> make_local(JType obj) noexcept
 {
-    return local_ref<JType>{ static_cast<JType>(env()->NewLocalRef(obj)) };
+    return internal::adopt_local(static_cast<JType>(env()->NewLocalRef(obj)));
+}
+template <typename JType> local_ref_in<JType> make_local(JNIEnv* e, JType obj) noexcept
+{
+    return internal::in_env(e, internal::new_local(e, obj));
+}
+
+//! PushLocalFrame() / PopLocalFrame(). local references created in the scope are deleted at its end,
+//! except the one passed to pop(). local_ref objects must not outlive the frame they were created in.
+class local_frame
+{
+public:
+    explicit local_frame(jint capacity = 16) : local_frame(env(), capacity)
+    {
+    }
+    local_frame(JNIEnv* e, jint capacity) : e_(e)
+    {
+        if (e_->PushLocalFrame(capacity) != 0) {
+            e_ = nullptr;
+            exception_check(e);
+            throw std::bad_alloc();
+        }
+    }
+    local_frame(const local_frame&) = delete;
+    local_frame& operator=(const local_frame&) = delete;
+    ~local_frame()
+    {
+        if (e_) e_->PopLocalFrame(nullptr);
+    }
+
+    //! pops the frame and returns "result" as a local reference of the outer frame.
+    template <typename JType> local_ref<JType> pop(local_ref<JType> result)
+    {
+        return pop(release_local(result));
+    }
+    template <typename JType> local_ref<JType> pop(local_ref_in<JType> result)
+    {
+        return pop(release_local(result));
+    }
+    template <typename JType, std::enable_if_t<is_derived_from_jobject<JType>::value, std::nullptr_t> = nullptr>
+    local_ref<JType> pop(JType result)
+    {
+        const auto e = e_;
+        e_ = nullptr;
+        return internal::adopt_local(e, static_cast<JType>(e->PopLocalFrame(result)));
+    }
+
+private:
+    JNIEnv* e_;
+};
+
+//! EnsureLocalCapacity().
+inline void ensure_local_capacity(JNIEnv* e, jint capacity)
+{
+    if (e->EnsureLocalCapacity(capacity) != 0) {
+        exception_check(e);
+        throw std::bad_alloc();
+    }
+}
+inline void ensure_local_capacity(jint capacity)
+{
+    ensure_local_capacity(env(), capacity);
+}
+
+namespace internal
+{
+    //! false for local references, which PopLocalFrame() would invalidate.
+    template <typename T> struct survives_local_frame : std::integral_constant<bool, !is_derived_from_jobject<std::decay_t<T>>::value> {};
+    template <typename T> struct survives_local_frame<local_ref<T>> : std::false_type {};
+
+    //! bulk object conversions longer than this run in local frames of this many elements.
+    constexpr jsize bulk_frame_elements = 128;
+
+    //! calls f(i) for i in [start, end). long ranges are split into local frames, so the local references
+    //! f leaves behind never exceed one frame.
+    template <typename F> void for_each_in_frames(JNIEnv* e, jsize start, jsize end, F&& f)
+    {
+        if (end - start <= bulk_frame_elements) {
+            for (jsize i = start; i < end; ++i) f(i);
+            return;
+        }
+        for (jsize i = start; i < end;) {
+            const auto ie = std::min(end, i + bulk_frame_elements);
+            local_frame frame(e, 2 * bulk_frame_elements);
+            for (; i < ie; ++i) f(i);
+        }
+    }
 }
 /*
 template <typename JType> using global_ref = std::shared_ptr<std::remove_pointer_t<JType>>;
@@ -175,7 +959,12 @@ private:
     template <typename T, std::enable_if_t<std::is_same<native_ref<T>, JType>::value, std::nullptr_t> = nullptr>
     static impl_type make_impl(const T& obj)
     {
-        return impl_type(static_cast<JType>(env()->NewGlobalRef(to_native_ref(obj))), [](JType p) { env()->DeleteGlobalRef(p); });
+        auto ref = static_cast<JType>(env()->NewGlobalRef(to_native_ref(obj)));
+        UC_JNI_REF_STATS(if (ref) internal::ref_counter<JType>().new_global();)
+        return impl_type(ref, [](JType p) {
+            UC_JNI_REF_STATS(if (p) internal::ref_counter<JType>().delete_global();)
+            env()->DeleteGlobalRef(p);
+        });
     }
     impl_type impl;
 };
@@ -196,12 +985,99 @@ JType make_global_or_primitive(const JType& obj)
     return obj;
 }
 
+//! move-only global reference. exactly one pointer; unlike global_ref, it allocates nothing and copies no reference count.
+template <typename JType> struct global_ref_deleter
+{
+    void operator()(JType p) const noexcept
+    {
+        UC_JNI_REF_STATS(internal::ref_counter<JType>().delete_global();)
+        env()->DeleteGlobalRef(p);
+    }
+};
+template <typename JType> using unique_global_ref = std::unique_ptr<std::remove_pointer_t<JType>, global_ref_deleter<JType>>;
+template <typename JType> unique_global_ref<native_ref<JType>> make_unique_global(const JType& obj)
+{
+    auto ref = static_cast<native_ref<JType>>(env()->NewGlobalRef(to_native_ref(obj)));
+    UC_JNI_REF_STATS(if (ref) internal::ref_counter<native_ref<JType>>().new_global();)
+    return unique_global_ref<native_ref<JType>>(ref);
+}
 
-//*************************************************************************************************
-// Weak Global References
-//*************************************************************************************************
-
-template <typename JType> class weak_ref
+//! copyable global reference for sharing within one thread. one pointer to a {reference, count} block;
+//! the count is not atomic, so copies must not be made or destroyed on different threads at the same time.
+template <typename JType> class confined_global_ref
+{
+public:
+    using element_type = std::remove_pointer_t<JType>;
+
+    constexpr confined_global_ref() noexcept = default;
+    template <typename T> explicit confined_global_ref(const T& obj)
+    {
+        auto ref = make_unique_global(obj);
+        if (ref) {
+            block_ = new block{ ref.get(), 1 };
+            ref.release();
+        }
+    }
+    confined_global_ref(const confined_global_ref& x) noexcept : block_(x.block_)
+    {
+        if (block_) ++block_->count;
+    }
+    confined_global_ref(confined_global_ref&& x) noexcept : block_(x.block_)
+    {
+        x.block_ = nullptr;
+    }
+    confined_global_ref& operator=(confined_global_ref x) noexcept
+    {
+        swap(x);
+        return *this;
+    }
+    ~confined_global_ref()
+    {
+        reset();
+    }
+    void reset() noexcept
+    {
+        if (block_ && --block_->count == 0) {
+            global_ref_deleter<JType>()(block_->ref);
+            delete block_;
+        }
+        block_ = nullptr;
+    }
+    void swap(confined_global_ref& x) noexcept
+    {
+        std::swap(block_, x.block_);
+    }
+    explicit operator bool() const noexcept
+    {
+        return block_ != nullptr;
+    }
+    JType get() const noexcept
+    {
+        return block_ ? block_->ref : nullptr;
+    }
+    std::size_t use_count() const noexcept
+    {
+        return block_ ? block_->count : 0;
+    }
+private:
+    struct block
+    {
+        JType ref;
+        std::size_t count;
+    };
+    block* block_ = nullptr;
+};
+template <typename JType> confined_global_ref<native_ref<JType>> make_confined_global(const JType& obj)
+{
+    return confined_global_ref<native_ref<JType>>(obj);
+}
+
+
+//*************************************************************************************************
+// Weak Global References
+//*************************************************************************************************
+
+template <typename JType> class weak_ref
 {
     using impl_type = std::shared_ptr<std::remove_pointer_t<jweak>>;
 public:
@@ -245,11 +1121,81 @@ private:
     template <typename T, std::enable_if_t<std::is_same<native_ref<T>, JType>::value, std::nullptr_t> = nullptr>
     static impl_type make_weak(const T& obj)
     {
-        return impl_type(env()->NewWeakGlobalRef(to_native_ref(obj)), [](jweak p) { env()->DeleteWeakGlobalRef(p); });
+        auto ref = env()->NewWeakGlobalRef(to_native_ref(obj));
+        UC_JNI_REF_STATS(if (ref) internal::ref_counter<JType>().new_weak();)
+        return impl_type(ref, [](jweak p) {
+            UC_JNI_REF_STATS(if (p) internal::ref_counter<JType>().delete_weak();)
+            env()->DeleteWeakGlobalRef(p);
+        });
     }
     impl_type impl;
 };
 
+//! move-only weak global reference. exactly one pointer; unlike weak_ref, it allocates nothing.
+template <typename JType> class unique_weak_ref
+{
+public:
+    using element_type = std::remove_pointer_t<jweak>;
+
+    constexpr unique_weak_ref() noexcept = default;
+    template <typename T, std::enable_if_t<std::is_same<native_ref<T>, JType>::value, std::nullptr_t> = nullptr>
+    explicit unique_weak_ref(const T& obj) : ref_(env()->NewWeakGlobalRef(to_native_ref(obj)))
+    {
+        UC_JNI_REF_STATS(if (ref_) internal::ref_counter<JType>().new_weak();)
+    }
+    unique_weak_ref(unique_weak_ref&& x) noexcept : ref_(x.ref_)
+    {
+        x.ref_ = nullptr;
+    }
+    unique_weak_ref& operator=(unique_weak_ref&& x) noexcept
+    {
+        unique_weak_ref(std::move(x)).swap(*this);
+        return *this;
+    }
+    ~unique_weak_ref()
+    {
+        reset();
+    }
+    void reset() noexcept
+    {
+        if (ref_) {
+            UC_JNI_REF_STATS(internal::ref_counter<JType>().delete_weak();)
+            env()->DeleteWeakGlobalRef(ref_);
+            ref_ = nullptr;
+        }
+    }
+    void swap(unique_weak_ref& x) noexcept
+    {
+        std::swap(ref_, x.ref_);
+    }
+    explicit operator bool() const noexcept
+    {
+        return ref_ != nullptr;
+    }
+    jweak get() const noexcept
+    {
+        return ref_;
+    }
+    local_ref<JType> lock() const
+    {
+        return make_local(static_cast<JType>(ref_));
+    }
+    bool expired() const
+    {
+        return env()->IsSameObject(ref_, nullptr) == JNI_TRUE;
+    }
+    template <typename T> bool is_same(const T& obj) const
+    {
+        return env()->IsSameObject(ref_, to_native_ref(obj)) == JNI_TRUE;
+    }
+private:
+    jweak ref_ = nullptr;
+};
+template <typename JType> unique_weak_ref<native_ref<JType>> make_unique_weak(const JType& obj)
+{
+    return unique_weak_ref<native_ref<JType>>(obj);
+}
+
 
 //*************************************************************************************************
 // Class and Object Operations
@@ -270,11 +1216,11 @@ inline local_ref<jclass> find_class_native(const char* fqcn)
 {
     auto o = env()->FindClass(fqcn);
     exception_check();
-    return local_ref<jclass>{o};
+    return internal::adopt_local(o);
 }
 template <typename JClass> local_ref<jclass> get_super_class(const JClass& clazz) noexcept
 {
-    return local_ref<jclass>{ env()->GetSuperclass(to_native_ref(clazz)) };
+    return internal::adopt_local(env()->GetSuperclass(to_native_ref(clazz)));
 }
 template <typename JClass1, typename JClass2> bool is_assignable_from(const JClass1& clazz1, const JClass2& clazz2) noexcept
 {
@@ -282,7 +1228,7 @@ template <typename JClass1, typename JClass2> bool is_assignable_from(const JCla
 }
 template <typename JType> local_ref<jclass> get_object_class(const JType& jobj) noexcept
 {
-    return local_ref<jclass>{ env()->GetObjectClass(to_native_ref(jobj)) };
+    return internal::adopt_local(env()->GetObjectClass(to_native_ref(jobj)));
 }
 template <typename JType, typename JClass> bool is_instance_of(const JType& jobj, const JClass& clazz) noexcept
 {
@@ -304,33 +1250,166 @@ namespace internal {
     {
         auto e = env();
         auto getClassLoader = e->GetMethodID(get_object_class(cls).get(), "getClassLoader", "()Ljava/lang/ClassLoader;");
-        auto classLoader = make_global(e->CallObjectMethod(cls.get(), getClassLoader));
+        auto classLoader = make_global(adopt_local(e->CallObjectMethod(cls.get(), getClassLoader)));
         auto findClass = e->GetMethodID(find_class_native("java/lang/ClassLoader").get(), "findClass", "(Ljava/lang/String;)Ljava/lang/Class;");
         return [classLoader = std::move(classLoader), findClass](const char* fqcn) {
-            auto o = static_cast<jclass>(env()->CallObjectMethod(classLoader.get(), findClass, env()->NewStringUTF(fqcn)));
-            if (env()->ExceptionCheck()) {
-                env()->ExceptionClear();
+            auto e = env();
+            auto name = adopt_local(e->NewStringUTF(fqcn));
+            auto o = static_cast<jclass>(e->CallObjectMethod(classLoader.get(), findClass, name.get()));
+            if (e->ExceptionCheck()) {
+                e->ExceptionClear();
                 return find_class_native(fqcn);
             }
-            return local_ref<jclass>{o};
+            return adopt_local(o);
         };
     }
-    inline std::function<local_ref<jclass>(const char*)>& class_loader_find_class_cache(std::function<local_ref<jclass>(const char*)>&& cache = {})
+
+    //! FQCN -> global class reference, resolved once per name. lookups take no lock: the table is open addressing
+    //! over immutable entries and is replaced, never rehashed in place, when it grows or the resolver changes.
+    //! replaced tables and entries live as long as the process, since a lookup may still be probing them.
+    class class_cache
     {
-        static auto instance(std::move(cache));
-        return instance;
-    }
+    public:
+        using resolver_type = std::function<local_ref<jclass>(const char*)>;
+
+        static class_cache& instance()
+        {
+            static auto cache = new class_cache();
+            return *cache;
+        }
+        //! returns null if the resolver returns null without throwing.
+        jclass get(const char* fqcn)
+        {
+            const auto hash = hash_of(fqcn);
+            if (const auto cls = lookup(*table_.load(std::memory_order_acquire), fqcn, hash)) return cls;
+            return resolve(fqcn, hash);
+        }
+        //! drops the cached classes, which the new resolver may resolve differently.
+        void set_resolver(resolver_type resolver)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            resolver_ = std::make_shared<const resolver_type>(std::move(resolver));
+            publish(16, false);
+        }
+
+    private:
+        struct entry
+        {
+            std::size_t hash;
+            std::string name;
+            unique_global_ref<jclass> cls;
+        };
+        struct table
+        {
+            explicit table(std::size_t size) : mask(size - 1), slots(new std::atomic<const entry*>[size])
+            {
+                for (std::size_t i = 0; i < size; ++i) {
+                    slots[i].store(nullptr, std::memory_order_relaxed);
+                }
+            }
+            std::size_t mask;
+            std::unique_ptr<std::atomic<const entry*>[]> slots;
+            std::size_t count = 0;
+        };
+
+        class_cache() : resolver_(std::make_shared<const resolver_type>(find_class_native))
+        {
+            publish(16, false);
+        }
+        static std::size_t hash_of(const char* fqcn) noexcept
+        {
+            // FNV-1a
+            std::size_t h = static_cast<std::size_t>(14695981039346656037ull);
+            for (; *fqcn; ++fqcn) {
+                h = (h ^ static_cast<unsigned char>(*fqcn)) * static_cast<std::size_t>(1099511628211ull);
+            }
+            return h;
+        }
+        static jclass lookup(const table& t, const char* fqcn, std::size_t hash) noexcept
+        {
+            for (auto i = hash & t.mask;; i = (i + 1) & t.mask) {
+                const auto p = t.slots[i].load(std::memory_order_acquire);
+                if (!p) return nullptr;
+                if (p->hash == hash && p->name == fqcn) return p->cls.get();
+            }
+        }
+        jclass resolve(const char* fqcn, std::size_t hash)
+        {
+            std::shared_ptr<const resolver_type> resolver;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                resolver = resolver_;
+            }
+            // resolve without the lock: loading a class may run code that resolves other classes.
+            auto cls = (*resolver)(fqcn);
+            if (!cls) return nullptr;
+            std::unique_ptr<entry> p(new entry{ hash, fqcn, make_unique_global(cls) });
+            std::lock_guard<std::mutex> lock(mutex_);
+            const auto t = table_.load(std::memory_order_relaxed);
+            if (const auto cached = lookup(*t, fqcn, hash)) return cached;
+            entries_.push_back(std::move(p));
+            const auto added = entries_.back().get();
+            // a class resolved by a replaced resolver is returned but not cached.
+            if (resolver != resolver_) return added->cls.get();
+            if ((t->count + 1) * 2 > t->mask + 1) {
+                publish((t->mask + 1) * 2, true);
+            }
+            insert(*table_.load(std::memory_order_relaxed), added);
+            return added->cls.get();
+        }
+        static void insert(table& t, const entry* p) noexcept
+        {
+            auto i = p->hash & t.mask;
+            while (t.slots[i].load(std::memory_order_relaxed)) {
+                i = (i + 1) & t.mask;
+            }
+            t.slots[i].store(p, std::memory_order_release);
+            ++t.count;
+        }
+        void publish(std::size_t size, bool keepEntries)
+        {
+            std::unique_ptr<table> t(new table(size));
+            const auto current = table_.load(std::memory_order_relaxed);
+            if (current && keepEntries) {
+                for (std::size_t i = 0; i <= current->mask; ++i) {
+                    if (const auto p = current->slots[i].load(std::memory_order_relaxed)) insert(*t, p);
+                }
+            }
+            table_.store(t.get(), std::memory_order_release);
+            tables_.push_back(std::move(t));
+        }
+
+        std::mutex mutex_;
+        std::shared_ptr<const resolver_type> resolver_;
+        std::atomic<table*> table_ { nullptr };
+        std::vector<std::unique_ptr<table>> tables_;
+        std::vector<std::unique_ptr<entry>> entries_;
+    };
 }
 
 template<typename JType> void replace_with_class_loader_find_class()
 {
-    internal::class_loader_find_class_cache(internal::get_class_loader_find_class_method(find_class_native(fqcn<JType>())));
+    internal::class_cache::instance().set_resolver(internal::get_class_loader_find_class_method(find_class_native(fqcn<JType>())));
 }
 
+//! resolved once per name (threads that miss at the same time may each resolve it; one result is kept) and cached
+//! for the life of the process. lookups of cached names take no lock.
 inline local_ref<jclass> find_class(const char* fqcn)
 {
-    const auto& find_class_fun = internal::class_loader_find_class_cache(find_class_native);
-    return find_class_fun(fqcn);
+    return make_local(internal::class_cache::instance().get(fqcn));
+}
+//! resolves classes ahead of time, e.g. in JNI_OnLoad(), so that later find_class() calls only look them up.
+inline void prefetch_classes(std::initializer_list<const char*> fqcns)
+{
+    for (auto fqcn : fqcns) {
+        internal::class_cache::instance().get(fqcn);
+    }
+}
+inline void prefetch_classes(const std::vector<std::string>& fqcns)
+{
+    for (auto&& fqcn : fqcns) {
+        internal::class_cache::instance().get(fqcn.c_str());
+    }
 }
 template<typename JType> jclass get_class()
 {
@@ -481,6 +1560,8 @@ template <typename T> struct type_traits<T*>
 {
     using jvalue_type = T*;
     static local_ref<jvalue_type> c_cast(jvalue_type v) noexcept { return make_local(v); }
+    static local_ref<jvalue_type> c_cast(JNIEnv* e, jvalue_type v) noexcept { return internal::new_local(e, v); }
+    static local_ref<jvalue_type> adopt(JNIEnv* e, jvalue_type v) noexcept { return internal::adopt_local(e, v); }
     template<typename V> static constexpr const V& j_cast(const V& v) noexcept { return v; }
     static constexpr decltype(auto) signature() noexcept { return make_cexprstr("L").append(fqcn<T*>()).append(";"); }
 };
@@ -488,6 +1569,8 @@ template <typename T> struct type_traits<local_ref<T>>
 {
     using jvalue_type = T;
     static local_ref<jvalue_type> c_cast(jvalue_type v) noexcept { return make_local(v); }
+    static local_ref<jvalue_type> c_cast(JNIEnv* e, jvalue_type v) noexcept { return internal::new_local(e, v); }
+    static local_ref<jvalue_type> adopt(JNIEnv* e, jvalue_type v) noexcept { return internal::adopt_local(e, v); }
     template<typename V> static constexpr const V& j_cast(const V& v) noexcept { return v; }
     static constexpr decltype(auto) signature() noexcept { return make_cexprstr("L").append(fqcn<T>()).append(";"); }
 };
@@ -498,15 +1581,161 @@ template <typename T> struct type_traits<global_ref<T>>
     template<typename V> static constexpr const V& j_cast(const V& v) noexcept { return v; }
     static constexpr decltype(auto) signature() noexcept { return make_cexprstr("L").append(fqcn<T>()).append(";"); }
 };
+template <typename T> struct type_traits<unique_global_ref<T>>
+{
+    using jvalue_type = T;
+    static unique_global_ref<jvalue_type> c_cast(jvalue_type v) noexcept { return make_unique_global(v); }
+    template<typename V> static constexpr const V& j_cast(const V& v) noexcept { return v; }
+    static constexpr decltype(auto) signature() noexcept { return make_cexprstr("L").append(fqcn<T>()).append(";"); }
+};
 template <> struct type_traits<jobjectArray>
 {
     using jvalue_type = jobjectArray;
     static local_ref<jvalue_type> c_cast(jvalue_type v) noexcept { return make_local(v); }
+    static local_ref<jvalue_type> c_cast(JNIEnv* e, jvalue_type v) noexcept { return internal::new_local(e, v); }
+    static local_ref<jvalue_type> adopt(JNIEnv* e, jvalue_type v) noexcept { return internal::adopt_local(e, v); }
     template<typename V> static constexpr const V& j_cast(const V& v) noexcept { return v; }
     static constexpr decltype(auto) signature() noexcept { return make_cexprstr("[").append(type_traits<jobject>::signature()); }
 };
 
+namespace internal
+{
+    //! type_traits<T>::c_cast(e, v) if the traits provide it, otherwise type_traits<T>::c_cast(v).
+    template <typename T, typename V> auto c_cast(JNIEnv* e, V v, std::nullptr_t) -> decltype(type_traits<T>::c_cast(e, v))
+    {
+        return type_traits<T>::c_cast(e, v);
+    }
+    template <typename T, typename V> decltype(auto) c_cast(JNIEnv*, V v, ...)
+    {
+        return type_traits<T>::c_cast(v);
+    }
+
+    //! converts a local reference just returned by JNI and takes ownership of it.
+    //! type_traits<T>::adopt(e, v) keeps it as the result (no NewLocalRef); otherwise it is deleted after c_cast,
+    //! unless c_cast returns it as a raw reference.
+    template <typename T, typename V> auto adopt_cast(JNIEnv* e, V v, std::nullptr_t) -> decltype(type_traits<T>::adopt(e, v))
+    {
+        return type_traits<T>::adopt(e, v);
+    }
+    template <typename T, typename V> decltype(auto) adopt_cast(JNIEnv* e, V v, std::true_type)
+    {
+        const auto owner = adopt_local(e, v);
+        return c_cast<T>(e, v, nullptr);
+    }
+    template <typename T, typename V> decltype(auto) adopt_cast(JNIEnv* e, V v, std::false_type)
+    {
+        return c_cast<T>(e, v, nullptr);
+    }
+    template <typename T, typename V> decltype(auto) adopt_cast(JNIEnv* e, V v, ...)
+    {
+        using result_type = std::decay_t<decltype(c_cast<T>(e, v, nullptr))>;
+        return adopt_cast<T>(e, v, std::integral_constant<bool, is_derived_from_jobject<V>::value && !is_derived_from_jobject<result_type>::value>{});
+    }
+}
+
+
+
+//*************************************************************************************************
+// Copy Statistics (define UC_JNI_ENABLE_COPY_STATS)
+//*************************************************************************************************
+#ifdef UC_JNI_ENABLE_COPY_STATS
+namespace copy_stats
+{
+    struct entry
+    {
+        std::string operation;  //!< get_region, set_region, get_elements, get_chars, to_basic_string, to_jstring, to_vector, to_jarray, direct_buffer
+        std::string element;    //!< boolean, byte, char, short, int, long, float, double, object, utf8
+        std::string direction;  //!< to_native (Java -> C++) or to_java (C++ -> Java)
+        std::uint64_t calls;
+        std::uint64_t elements;
+        std::uint64_t bytes;
+        std::uint64_t copies;   //!< calls that really copied. get_elements, get_chars: isCopy == JNI_TRUE, direct_buffer: 0
+    };
+}
+
+namespace internal
+{
+    enum copy_operation { copy_get_region, copy_set_region, copy_get_elements, copy_get_chars, copy_to_basic_string, copy_to_jstring, copy_to_vector, copy_to_jarray, copy_direct_buffer, copy_operation_count };
+    enum copy_direction { copy_to_native, copy_to_java, copy_direction_count };
+    constexpr size_t copy_element_count = 10;
+
+    //! object references by default.
+    template <typename T> struct copy_element : std::integral_constant<size_t, 8> {};
+    template <> struct copy_element<jboolean> : std::integral_constant<size_t, 0> {};
+    template <> struct copy_element<bool>     : std::integral_constant<size_t, 0> {};
+    template <> struct copy_element<jbyte>    : std::integral_constant<size_t, 1> {};
+    template <> struct copy_element<jchar>    : std::integral_constant<size_t, 2> {};
+    template <> struct copy_element<char16_t> : std::integral_constant<size_t, 2> {};
+    template <> struct copy_element<jshort>   : std::integral_constant<size_t, 3> {};
+    template <> struct copy_element<jint>     : std::integral_constant<size_t, 4> {};
+    template <> struct copy_element<jlong>    : std::integral_constant<size_t, 5> {};
+    template <> struct copy_element<jfloat>   : std::integral_constant<size_t, 6> {};
+    template <> struct copy_element<jdouble>  : std::integral_constant<size_t, 7> {};
+    template <> struct copy_element<char>     : std::integral_constant<size_t, 9> {};
+
+    struct copy_counter
+    {
+        std::atomic<std::uint64_t> calls;
+        std::atomic<std::uint64_t> elements;
+        std::atomic<std::uint64_t> bytes;
+        std::atomic<std::uint64_t> copies;
+    };
+    inline copy_counter& copy_counter_at(size_t operation, size_t element, size_t direction) noexcept
+    {
+        static copy_counter table[copy_operation_count][copy_element_count][copy_direction_count] {};
+        return table[operation][element][direction];
+    }
+    template <typename T> void record_copy(copy_operation operation, copy_direction direction, size_t elements, bool copied = true) noexcept
+    {
+        auto& c = copy_counter_at(operation, copy_element<std::remove_cv_t<T>>::value, direction);
+        c.calls.fetch_add(1, std::memory_order_relaxed);
+        c.elements.fetch_add(elements, std::memory_order_relaxed);
+        c.bytes.fetch_add(elements * sizeof(T), std::memory_order_relaxed);
+        if (copied) c.copies.fetch_add(1, std::memory_order_relaxed);
+    }
+}
 
+namespace copy_stats
+{
+    //! non-zero counters since the last reset().
+    inline std::vector<entry> snapshot()
+    {
+        static const char* const operations[] = { "get_region", "set_region", "get_elements", "get_chars", "to_basic_string", "to_jstring", "to_vector", "to_jarray", "direct_buffer" };
+        static const char* const elements[] = { "boolean", "byte", "char", "short", "int", "long", "float", "double", "object", "utf8" };
+        static const char* const directions[] = { "to_native", "to_java" };
+        std::vector<entry> ret;
+        for (size_t o = 0; o < internal::copy_operation_count; ++o) {
+            for (size_t e = 0; e < internal::copy_element_count; ++e) {
+                for (size_t d = 0; d < internal::copy_direction_count; ++d) {
+                    auto& c = internal::copy_counter_at(o, e, d);
+                    const auto calls = c.calls.load(std::memory_order_relaxed);
+                    if (calls == 0) continue;
+                    ret.push_back(entry{ operations[o], elements[e], directions[d], calls,
+                        c.elements.load(std::memory_order_relaxed), c.bytes.load(std::memory_order_relaxed), c.copies.load(std::memory_order_relaxed) });
+                }
+            }
+        }
+        return ret;
+    }
+    inline void reset() noexcept
+    {
+        for (size_t o = 0; o < internal::copy_operation_count; ++o) {
+            for (size_t e = 0; e < internal::copy_element_count; ++e) {
+                for (size_t d = 0; d < internal::copy_direction_count; ++d) {
+                    auto& c = internal::copy_counter_at(o, e, d);
+                    c.calls.store(0, std::memory_order_relaxed);
+                    c.elements.store(0, std::memory_order_relaxed);
+                    c.bytes.store(0, std::memory_order_relaxed);
+                    c.copies.store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+}
+#define UC_JNI_COPY_STATS(...) __VA_ARGS__
+#else
+#define UC_JNI_COPY_STATS(...)
+#endif
 
 //*************************************************************************************************
 // String Operations
@@ -544,12 +1773,16 @@ template<> struct string_traits<char16_t>
 template <typename T, typename Traits = string_traits<T>> decltype(auto) get_chars(jstring str, jboolean* isCopy = nullptr)
 {
     auto deleter = [str](const T* p) { Traits::release_chars(env(), str, p); };
-    return std::unique_ptr<const T, decltype(deleter)>(Traits::get_chars(env(), str, isCopy), std::move(deleter));
+    UC_JNI_COPY_STATS(jboolean copied = JNI_FALSE; if (!isCopy) isCopy = &copied;)
+    auto ret = std::unique_ptr<const T, decltype(deleter)>(Traits::get_chars(env(), str, isCopy), std::move(deleter));
+    UC_JNI_COPY_STATS(if (ret) internal::record_copy<T>(internal::copy_get_chars, internal::copy_to_native, static_cast<size_t>(Traits::length(env(), str)), *isCopy == JNI_TRUE);)
+    return ret;
 }
 
 template <typename T, typename Traits = string_traits<T>> local_ref<jstring> to_jstring(const T* str, size_t n) noexcept
 {
-    return local_ref<jstring>{ Traits::new_string(env(), str, static_cast<jsize>(n)) };
+    UC_JNI_COPY_STATS(internal::record_copy<T>(internal::copy_to_jstring, internal::copy_to_java, n);)
+    return internal::adopt_local(Traits::new_string(env(), str, static_cast<jsize>(n)));
 }
 template <typename T, typename Traits = string_traits<T>> local_ref<jstring> to_jstring(const std::basic_string<T>& str) noexcept
 {
@@ -575,17 +1808,23 @@ namespace internal
 
 //! Convert to std::basic_string from jstring. If it is null it returns an empty string.
 template <typename T, typename JStr, typename Traits = string_traits<T>>
-std::basic_string<T> to_basic_string(const JStr& str)
+std::basic_string<T> to_basic_string(JNIEnv* e, const JStr& str)
 {
+    UC_JNI_TRACE_SCOPE("to_basic_string", "convert", nullptr)
     std::basic_string<T> ret;
     auto jstr = internal::as_jstring(str);
     if (jstr) {
-        auto e = env();
         ret.resize(Traits::length(e, jstr), 0);
         Traits::get_region(e, jstr, 0, e->GetStringLength(jstr), &ret[0]);
+        UC_JNI_COPY_STATS(internal::record_copy<T>(internal::copy_to_basic_string, internal::copy_to_native, ret.size());)
     }
     return  ret;
 }
+template <typename T, typename JStr, typename Traits = string_traits<T>>
+std::basic_string<T> to_basic_string(const JStr& str)
+{
+    return to_basic_string<T, JStr, Traits>(env(), str);
+}
 template <typename JStr> std::string to_string(const JStr& str)
 {
     return to_basic_string<char>(str);
@@ -637,6 +1876,7 @@ template <typename T, typename... Ts> void join_buffer(string_buffer& buf, T&& s
 }
 template <typename... Ts> local_ref<jstring> join(Ts&&... strings)
 {
+    UC_JNI_TRACE_SCOPE("join", "convert", nullptr)
     string_buffer buf;
     join_buffer(buf, std::forward<Ts>(strings)...);
     return to_jstring(buf);
@@ -647,6 +1887,7 @@ template<typename T> struct type_traits<std::basic_string<T>>
 {
     using jvalue_type = jstring;
     static std::basic_string<T> c_cast(jstring v) { return to_basic_string<T>(v); }
+    static std::basic_string<T> c_cast(JNIEnv* e, jstring v) { return to_basic_string<T>(e, v); }
     static decltype(auto) j_cast(const std::basic_string<T>& v) { return to_jstring(v); }
     static constexpr decltype(auto) signature() noexcept { return type_traits<jvalue_type>::signature(); }
 };
@@ -732,6 +1973,8 @@ template <typename T> struct type_traits<array<T>>
 {
     using jvalue_type = array<T>;
     static decltype(auto) c_cast(jvalue_type v) noexcept { return make_local(v); }
+    static decltype(auto) c_cast(JNIEnv* e, jvalue_type v) noexcept { return internal::new_local(e, v); }
+    static local_ref<jvalue_type> adopt(JNIEnv* e, jvalue_type v) noexcept { return internal::adopt_local(e, v); }
     template<typename V> static constexpr const V& j_cast(const V& v) noexcept { return v; }
     static constexpr decltype(auto) signature() noexcept { return make_cexprstr("[").append(type_traits<T>::signature()); }
 };
@@ -757,10 +2000,20 @@ DEFINE_ARRAY_TRAITS(jdouble , jdoubleArray);
 template<typename T> using native_array_t = typename array_traits<typename type_traits<T>::jvalue_type>::type;
 template<typename JArray> using native_array_element_t = typename array_element_traits<native_ref<JArray>>::type;
 
+template <typename T, std::enable_if_t<is_base_ptr_of<jarray, T>::value, std::nullptr_t> = nullptr>
+jsize length(JNIEnv* e, T array) noexcept
+{
+    return e->GetArrayLength(array);
+}
+template <typename T, std::enable_if_t<is_base_ptr_of<jarray, typename T::element_type*>::value, std::nullptr_t> = nullptr>
+jsize length(JNIEnv* e, const T& array) noexcept
+{
+    return length(e, array.get());
+}
 template <typename T, std::enable_if_t<is_base_ptr_of<jarray, T>::value, std::nullptr_t> = nullptr>
 jsize length(T array) noexcept
 {
-    return env()->GetArrayLength(array);
+    return length(env(), array);
 }
 template <typename T, std::enable_if_t<is_base_ptr_of<jarray, typename T::element_type*>::value, std::nullptr_t> = nullptr>
 jsize length(const T& array) noexcept
@@ -768,47 +2021,75 @@ jsize length(const T& array) noexcept
     return length(array.get());
 }
 
+template <typename T, typename Traits = function_traits<native_array_t<T>>, std::enable_if_t<is_primitive_type<T>::value, std::nullptr_t> = nullptr>
+local_ref_in<native_array_t<T>> new_array(JNIEnv* e, jsize length)
+{
+    return internal::in_env(e, internal::adopt_local(Traits::new_array(e, length)));
+}
 template <typename T, typename Traits = function_traits<native_array_t<T>>, std::enable_if_t<is_primitive_type<T>::value, std::nullptr_t> = nullptr>
 local_ref<native_array_t<T>> new_array(jsize length)
 {
-    return local_ref<native_array_t<T>>{ Traits::new_array(env(), length) };
+    return internal::adopt_local(Traits::new_array(env(), length));
+}
+template <typename JArray, typename Traits = function_traits<native_ref<JArray>>, std::enable_if_t<is_primitive_array_type<native_ref<JArray>>::value, std::nullptr_t> = nullptr>
+void get_region(JNIEnv* e, const JArray& array, jsize start, jsize len, typename Traits::value_type* buf)
+{
+    Traits::get_region(e, to_native_ref(array), start, len, buf);
+    UC_JNI_COPY_STATS(internal::record_copy<typename Traits::value_type>(internal::copy_get_region, internal::copy_to_native, len);)
+}
+template <typename JArray, typename Traits = function_traits<native_ref<JArray>>, std::enable_if_t<is_primitive_array_type<native_ref<JArray>>::value, std::nullptr_t> = nullptr>
+void set_region(JNIEnv* e, const JArray& array, jsize start, jsize len, const typename Traits::value_type* buf)
+{
+    Traits::set_region(e, to_native_ref(array), start, len, buf);
+    UC_JNI_COPY_STATS(internal::record_copy<typename Traits::value_type>(internal::copy_set_region, internal::copy_to_java, len);)
 }
 template <typename JArray, typename Traits = function_traits<native_ref<JArray>>, std::enable_if_t<is_primitive_array_type<native_ref<JArray>>::value, std::nullptr_t> = nullptr>
 void get_region(const JArray& array, jsize start, jsize len, typename Traits::value_type* buf)
 {
-    Traits::get_region(env(), to_native_ref(array), start, len, buf);
+    get_region(env(), array, start, len, buf);
 }
 template <typename JArray, typename Traits = function_traits<native_ref<JArray>>, std::enable_if_t<is_primitive_array_type<native_ref<JArray>>::value, std::nullptr_t> = nullptr>
 void set_region(const JArray& array, jsize start, jsize len, const typename Traits::value_type* buf)
 {
-    Traits::set_region(env(), to_native_ref(array), start, len, buf);
+    set_region(env(), array, start, len, buf);
 }
 
 // array elements
 
+//! releases with "e" if it is set (explicit JNIEnv* API), otherwise with env().
 template<typename Traits> struct array_elements_deleter
 {
     void operator()(typename Traits::value_type* p) const noexcept
     {
-        Traits::release_elements(env(), array, p, release_mode);
+        Traits::release_elements(e ? e : env(), array, p, release_mode);
     }
     void operator()(const typename Traits::value_type* p) const noexcept
     {
-        Traits::release_elements(env(), array, const_cast<typename Traits::value_type*>(p), release_mode);
+        Traits::release_elements(e ? e : env(), array, const_cast<typename Traits::value_type*>(p), release_mode);
     }
     typename Traits::array_type array;
     jint release_mode;
+    JNIEnv* e{};
 };
 template <typename Traits> using array_elements = std::unique_ptr<typename Traits::value_type, array_elements_deleter<Traits>>;
 
+template <typename JArray, typename Traits = function_traits<native_ref<JArray>>>
+array_elements<Traits> get_elements(JNIEnv* e, const JArray& array, jboolean* isCopy = nullptr)
+{
+    UC_JNI_COPY_STATS(jboolean copied = JNI_FALSE; if (!isCopy) isCopy = &copied;)
+    auto ret = array_elements<Traits>(Traits::get_elements(e, to_native_ref(array), isCopy), array_elements_deleter<Traits>{to_native_ref(array), 0, e});
+    UC_JNI_COPY_STATS(if (ret) internal::record_copy<typename Traits::value_type>(internal::copy_get_elements, internal::copy_to_native, length(e, to_native_ref(array)), *isCopy == JNI_TRUE);)
+    return ret;
+}
 template <typename JArray, typename Traits = function_traits<native_ref<JArray>>>
 array_elements<Traits> get_elements(const JArray& array, jboolean* isCopy = nullptr)
 {
-    return array_elements<Traits>(Traits::get_elements(env(), to_native_ref(array), isCopy), array_elements_deleter<Traits>{to_native_ref(array), 0});
+    return get_elements(env(), array, isCopy);
 }
 template <typename Traits> void commit(array_elements<Traits>& elems)
 {
-    Traits::release_elements(env(), elems.get_deleter().array, elems.get(), JNI_COMMIT);
+    const auto& d = elems.get_deleter();
+    Traits::release_elements(d.e ? d.e : env(), d.array, elems.get(), JNI_COMMIT);
 }
 template <typename Traits> void set_abort(array_elements<Traits>& elems, bool abortive = true)
 {
@@ -835,10 +2116,18 @@ template <typename Traits> const typename array_elements<Traits>::pointer end(co
 
 template <typename Traits> using const_array_elements = std::unique_ptr<const typename Traits::value_type, array_elements_deleter<Traits>>;
 
+template <typename JArray, typename Traits = function_traits<native_ref<JArray>>>
+const_array_elements<Traits> get_const_elements(JNIEnv* e, const JArray& array, jboolean* isCopy = nullptr)
+{
+    UC_JNI_COPY_STATS(jboolean copied = JNI_FALSE; if (!isCopy) isCopy = &copied;)
+    auto ret = const_array_elements<Traits>(Traits::get_elements(e, to_native_ref(array), isCopy), array_elements_deleter<Traits>{to_native_ref(array), JNI_ABORT, e});
+    UC_JNI_COPY_STATS(if (ret) internal::record_copy<typename Traits::value_type>(internal::copy_get_elements, internal::copy_to_native, length(e, to_native_ref(array)), *isCopy == JNI_TRUE);)
+    return ret;
+}
 template <typename JArray, typename Traits = function_traits<native_ref<JArray>>>
 const_array_elements<Traits> get_const_elements(const JArray& array, jboolean* isCopy = nullptr)
 {
-    return array_elements<Traits>(Traits::get_elements(env(), to_native_ref(array), isCopy), array_elements_deleter<Traits>{to_native_ref(array), JNI_ABORT});
+    return get_const_elements(env(), array, isCopy);
 }
 template <typename Traits> typename const_array_elements<Traits>::pointer begin(const const_array_elements<Traits>& elems)
 {
@@ -853,16 +2142,32 @@ template <typename Traits> typename const_array_elements<Traits>::pointer end(co
 // Object Array Operations
 //*************************************************************************************************
 
+template <typename T, std::enable_if_t<is_derived_from_jobject<T>::value, std::nullptr_t> = nullptr>
+local_ref_in<array<T>> new_array(JNIEnv* e, jsize length)
+{
+    return internal::in_env(e, internal::adopt_local(static_cast<array<T>>(e->NewObjectArray(length, get_class<T>(), nullptr))));
+}
 template <typename T, std::enable_if_t<is_derived_from_jobject<T>::value, std::nullptr_t> = nullptr>
 local_ref<array<T>> new_array(jsize length)
 {
-    return local_ref<array<T>>{ static_cast<array<T>>(env()->NewObjectArray(length, get_class<T>(), nullptr)) };
+    return internal::adopt_local(static_cast<array<T>>(env()->NewObjectArray(length, get_class<T>(), nullptr)));
+}
+template <typename JObjArray, std::enable_if_t<is_derived_from_jobject<native_array_element_t<JObjArray>>::value, std::nullptr_t> = nullptr> 
+decltype(auto) get(JNIEnv* e, const JObjArray& array, jsize index) noexcept
+{
+    using jvalue_type = native_array_element_t<JObjArray>;
+    return internal::in_env(e, internal::adopt_local(static_cast<jvalue_type>(e->GetObjectArrayElement(to_native_ref(array), index))));
+}
+template <typename JObjArray, typename JType, std::enable_if_t<is_derived_from_jobject<native_array_element_t<JObjArray>>::value, std::nullptr_t> = nullptr> 
+void set(JNIEnv* e, JObjArray& array, jsize index, const JType& value) noexcept
+{
+    e->SetObjectArrayElement(to_native_ref(array), index, to_native_ref(value));
 }
 template <typename JObjArray, std::enable_if_t<is_derived_from_jobject<native_array_element_t<JObjArray>>::value, std::nullptr_t> = nullptr> 
 decltype(auto) get(const JObjArray& array, jsize index) noexcept
 {
     using jvalue_type = native_array_element_t<JObjArray>;
-    return local_ref<jvalue_type>{ static_cast<jvalue_type>(env()->GetObjectArrayElement(to_native_ref(array), index)) };
+    return internal::adopt_local(static_cast<jvalue_type>(env()->GetObjectArrayElement(to_native_ref(array), index)));
 }
 template <typename JObjArray, typename JType, std::enable_if_t<is_derived_from_jobject<native_array_element_t<JObjArray>>::value, std::nullptr_t> = nullptr> 
 void set(JObjArray& array, jsize index, const JType& value) noexcept
@@ -875,9 +2180,15 @@ OutItr get_region(const JObjArray& array, jsize start, jsize len, OutItr itr, F
     using jvalue_type = native_array_element_t<JObjArray>;
     const auto e = env();
     auto arr = to_native_ref(array);
-    for (jsize i = start, ie = start + len; i < ie; ++i) {
-        *itr = transform(local_ref<jvalue_type>{ static_cast<jvalue_type>(e->GetObjectArrayElement(arr, i)) });
+    auto element = [&](jsize i) {
+        *itr = transform(internal::adopt_local(static_cast<jvalue_type>(e->GetObjectArrayElement(arr, i))));
         ++itr;
+    };
+    // results that are references of the current frame must not be popped.
+    if (internal::survives_local_frame<std::decay_t<decltype(transform(local_ref<jvalue_type>{}))>>::value) {
+        internal::for_each_in_frames(e, start, start + len, element);
+    } else {
+        for (jsize i = start, ie = start + len; i < ie; ++i) element(i);
     }
     return itr;
 }
@@ -886,11 +2197,11 @@ InItr set_region(JObjArray& array, jsize start, jsize len, InItr itr, F transfor
 {
     const auto e = env();
     auto arr = to_native_ref(array);
-    for (jsize i = start, ie = start + len; i < ie; ++i) {
-        auto lref = make_local(transform(*itr));
-        e->SetObjectArrayElement(arr, i, lref.get());
+    internal::for_each_in_frames(e, start, start + len, [&](jsize i) {
+        const auto& value = transform(*itr);
+        e->SetObjectArrayElement(arr, i, to_native_ref(value));
         ++itr;
-    }
+    });
     return itr;
 }
 
@@ -898,6 +2209,7 @@ InItr set_region(JObjArray& array, jsize start, jsize len, InItr itr, F transfor
 template <typename T, typename JArray, std::enable_if_t<std::is_same<T, bool>::value && std::is_same<native_ref<JArray>, jbooleanArray>::value, std::nullptr_t> = nullptr> 
 std::vector<T> to_vector(const JArray& array)
 {
+    UC_JNI_TRACE_SCOPE("to_vector", "convert", nullptr)
     auto elems = get_const_elements(array);
     return std::vector<bool>(jni::begin(elems), jni::end(elems));
 }
@@ -905,9 +2217,11 @@ std::vector<T> to_vector(const JArray& array)
 template <typename T, typename JArray, std::enable_if_t<is_primitive_type<T>::value && is_primitive_array_type<native_ref<JArray>>::value, std::nullptr_t> = nullptr> 
 std::vector<T> to_vector(const JArray& array)
 {
+    UC_JNI_TRACE_SCOPE("to_vector", "convert", nullptr)
     const auto len = length(array);
     std::vector<T> ret(len);
-    get_region(array, 0, len, ret.data());
+    function_traits<native_ref<JArray>>::get_region(env(), to_native_ref(array), 0, len, ret.data());
+    UC_JNI_COPY_STATS(internal::record_copy<T>(internal::copy_to_vector, internal::copy_to_native, ret.size());)
     return ret;
 }
 template <typename JArray, std::enable_if_t<is_primitive_array_type<native_ref<JArray>>::value, std::nullptr_t> = nullptr> 
@@ -919,6 +2233,7 @@ decltype(auto) to_vector(const JArray& array)
 template <typename T, typename JArray, std::enable_if_t<is_derived_from_jobject<typename type_traits<T>::jvalue_type>::value && is_derived_from_jobjectArray<native_ref<JArray>>::value, std::nullptr_t> = nullptr>
 std::vector<T> to_vector(const JArray& array)
 {
+    UC_JNI_TRACE_SCOPE("to_vector", "convert", nullptr)
     using jvalue_type = typename type_traits<T>::jvalue_type;
     std::vector<T> ret;
     auto arr = to_native_ref(array);
@@ -926,10 +2241,15 @@ std::vector<T> to_vector(const JArray& array)
         const auto e = env();
         const auto len = length(array);
         ret.reserve(len);
-        for (jsize i = 0; i < len; ++i) {
-            auto lref = local_ref<jvalue_type>{ static_cast<jvalue_type>(e->GetObjectArrayElement(arr, i)) };
-            ret.emplace_back(type_traits<T>::c_cast(lref.get()));
+        auto element = [&](jsize i) {
+            ret.emplace_back(internal::adopt_cast<T>(e, static_cast<jvalue_type>(e->GetObjectArrayElement(arr, i)), nullptr));
+        };
+        if (internal::survives_local_frame<T>::value) {
+            internal::for_each_in_frames(e, 0, len, element);
+        } else {
+            for (jsize i = 0; i < len; ++i) element(i);
         }
+        UC_JNI_COPY_STATS(internal::record_copy<jvalue_type>(internal::copy_to_vector, internal::copy_to_native, ret.size());)
     }
     return ret;
 }
@@ -938,9 +2258,11 @@ std::vector<T> to_vector(const JArray& array)
 template <typename T, std::enable_if_t<is_primitive_type<T>::value, std::nullptr_t> = nullptr> 
 local_ref<native_array_t<T>> to_jarray(const T* data, size_t dataCount)
 {
+    UC_JNI_TRACE_SCOPE("to_jarray", "convert", nullptr)
     const auto len = static_cast<jsize>(dataCount);
     auto ret = new_array<T>(len);
-    set_region(ret, 0, len, data);
+    function_traits<native_array_t<T>>::set_region(env(), ret.get(), 0, len, data);
+    UC_JNI_COPY_STATS(internal::record_copy<T>(internal::copy_to_jarray, internal::copy_to_java, dataCount);)
     return ret;
 }
 template <typename T, std::enable_if_t<is_primitive_type<T>::value, std::nullptr_t> = nullptr> 
@@ -951,6 +2273,7 @@ local_ref<native_array_t<T>> to_jarray(const std::vector<T>& vec)
 template <typename T, std::enable_if_t<std::is_same<T, bool>::value, std::nullptr_t> = nullptr> 
 local_ref<jbooleanArray> to_jarray(const std::vector<T>& vec)
 {
+    UC_JNI_TRACE_SCOPE("to_jarray", "convert", nullptr)
     auto ret = new_array<jboolean>(static_cast<jsize>(vec.size()));
     auto elems = get_elements(ret);
     std::copy(vec.begin(), vec.end(), jni::begin(elems));
@@ -959,12 +2282,14 @@ local_ref<jbooleanArray> to_jarray(const std::vector<T>& vec)
 template <typename T, std::enable_if_t<is_derived_from_jobject<typename type_traits<T>::jvalue_type>::value, std::nullptr_t> = nullptr> 
 local_ref<native_array_t<T>> to_jarray(const std::vector<T>& vec)
 {
+    UC_JNI_TRACE_SCOPE("to_jarray", "convert", nullptr)
     const auto e = env();
     const auto len = static_cast<jsize>(vec.size());
     auto ret = new_array<typename type_traits<T>::jvalue_type>(len);
-    for (jsize i = 0; i < len; ++i) {
+    internal::for_each_in_frames(e, 0, len, [&](jsize i) {
         e->SetObjectArrayElement(ret.get(), i, to_native_ref(type_traits<T>::j_cast(vec[i])));
-    }
+    });
+    UC_JNI_COPY_STATS(internal::record_copy<typename type_traits<T>::jvalue_type>(internal::copy_to_jarray, internal::copy_to_java, vec.size());)
     return ret;
 }
 
@@ -982,10 +2307,19 @@ template <typename T> struct type_traits<std::vector<T>>
 // Field IDs and Method IDs
 //*************************************************************************************************
 
-template<typename T> const char* get_signature() noexcept
+namespace internal
+{
+    //! signatures are constant data, built at compile time.
+    template <typename T> struct signature_constant
+    {
+        using value_type = decltype(type_traits<T>::signature());
+        static constexpr value_type value = type_traits<T>::signature();
+    };
+    template <typename T> constexpr typename signature_constant<T>::value_type signature_constant<T>::value;
+}
+template<typename T> constexpr const char* get_signature() noexcept
 {
-    static auto instance = type_traits<T>::signature();
-    return instance.c_str();
+    return internal::signature_constant<T>::value.c_str();
 }
 template<typename JType, typename T> jfieldID get_field_id(const char* name)
 {
@@ -1006,49 +2340,346 @@ template<typename JType, typename T> jmethodID get_static_method_id(const char*
 
 
 //*************************************************************************************************
-// Accessing Fields
+// Call Site Metrics (define UC_JNI_ENABLE_METRICS)
 //*************************************************************************************************
-
-template<typename JType, typename T> struct field
+#ifdef UC_JNI_ENABLE_METRICS
+namespace metrics
 {
-    template<typename JObj> decltype(auto) get(const JObj& obj) const
-    {
-        return type_traits<T>::c_cast(function_traits<typename type_traits<T>::jvalue_type>::get_field(env(), jni::to_native_ref(obj), id));
-    }
-    template<typename JObj, typename U> void set(const JObj& obj, const U& value) const
+    //! bucket i counts calls that took [2^(i-1), 2^i) ns. bucket 0 is "< 1ns", the last bucket is unbounded.
+    constexpr size_t histogram_buckets = 40;
+
+    using call_site_id = size_t;
+    constexpr call_site_id invalid_call_site = ~call_site_id{};
+
+    struct call_site_stats
     {
-        function_traits<typename type_traits<T>::jvalue_type>::set_field(env(), jni::to_native_ref(obj), id, type_traits<T>::j_cast(value));
-    }
-    jfieldID id{};
-};
-template <typename JType, typename T> field<JType, T> make_field(const char* name)
-{
-    return field<JType, T>{ get_field_id<JType, T>(name) };
+        std::string kind;       //!< method, non_virtual_method, static_method, constructor, field, static_field
+        std::string class_name; //!< FQCN
+        std::string name;
+        std::string signature;
+        std::uint64_t calls;
+        std::uint64_t total_ns;
+        std::array<std::uint64_t, histogram_buckets> histogram;
+    };
 }
 
-//*************************************************************************************************
-// Accessing Static Fields
-//*************************************************************************************************
-
-template<typename JType, typename T> struct static_field
+namespace internal
 {
-    decltype(auto) get() const
+    constexpr size_t metrics_chunk_size = 64;
+    constexpr size_t metrics_max_chunks = 256;
+
+    struct metrics_counter
     {
-        return type_traits<T>::c_cast(function_traits<typename type_traits<T>::jvalue_type>::get_static_field(env(), get_class<JType>(), id));
-    }
-    template<typename U> void set(const U& value) const
+        std::uint64_t calls;
+        std::uint64_t total_ns;
+        std::array<std::uint64_t, metrics::histogram_buckets> histogram;
+    };
+
+    //! written only by the owning thread; read by snapshot() from any thread.
+    struct metrics_slot
     {
-        function_traits<typename type_traits<T>::jvalue_type>::set_static_field(env(), get_class<JType>(), id, type_traits<T>::j_cast(value));
-    }
-    jfieldID id{};
-};
-template <typename JType, typename T> static_field<JType, T> make_static_field(const char* name)
-{
-    return static_field<JType, T>{ get_static_field_id<JType, T>(name) };
-}
+        std::atomic<std::uint64_t> calls;
+        std::atomic<std::uint64_t> total_ns;
+        std::atomic<std::uint64_t> histogram[metrics::histogram_buckets];
 
-//*************************************************************************************************
-// Calling Instance Methods
+        static void increment(std::atomic<std::uint64_t>& v, std::uint64_t n) noexcept
+        {
+            v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+        static size_t bucket(std::uint64_t ns) noexcept
+        {
+#if defined(__GNUC__)
+            size_t b = ns ? 64 - __builtin_clzll(ns) : 0;
+#else
+            size_t b = 0;
+            for (; ns; ns >>= 1) ++b;
+#endif
+            return std::min(b, metrics::histogram_buckets - 1);
+        }
+        void record(std::uint64_t ns) noexcept
+        {
+            increment(calls, 1);
+            increment(total_ns, ns);
+            increment(histogram[bucket(ns)], 1);
+        }
+        void add_to(metrics_counter& c) const noexcept
+        {
+            c.calls += calls.load(std::memory_order_relaxed);
+            c.total_ns += total_ns.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < metrics::histogram_buckets; ++i) {
+                c.histogram[i] += histogram[i].load(std::memory_order_relaxed);
+            }
+        }
+    };
+    struct metrics_chunk
+    {
+        metrics_slot slots[metrics_chunk_size];
+    };
+
+    class metrics_thread_slots
+    {
+    public:
+        metrics_thread_slots();
+        ~metrics_thread_slots();
+        metrics_slot* slot(metrics::call_site_id id) noexcept
+        {
+            auto& c = chunks[id / metrics_chunk_size];
+            auto p = c.load(std::memory_order_relaxed);
+            if (!p) {
+                p = new(std::nothrow) metrics_chunk();
+                if (!p) return nullptr;
+                c.store(p, std::memory_order_release);
+            }
+            return &p->slots[id % metrics_chunk_size];
+        }
+        std::atomic<metrics_chunk*> chunks[metrics_max_chunks] {};
+    };
+
+    class metrics_registry
+    {
+    public:
+        static metrics_registry& instance()
+        {
+            // never destroyed: thread_local slots of other threads may outlive static destruction.
+            static auto singleton = new metrics_registry();
+            return *singleton;
+        }
+
+        metrics::call_site_id register_call_site(const char* kind, const char* className, const char* name, const char* signature)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto key = std::string(kind) + ' ' + className + '.' + name + signature;
+            auto found = index.find(key);
+            if (found != index.end()) return found->second;
+            if (sites.size() >= metrics_chunk_size * metrics_max_chunks) return metrics::invalid_call_site;
+            sites.push_back(metrics::call_site_stats{ kind, className, name, signature, 0, 0, {} });
+            retired.push_back({});
+            baseline.push_back({});
+            return index[key] = sites.size() - 1;
+        }
+        void attach(metrics_thread_slots* t)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            threads.push_back(t);
+        }
+        //! fold the counters of an exiting thread into "retired".
+        void detach(metrics_thread_slots* t)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            collect(t, retired);
+            threads.erase(std::find(threads.begin(), threads.end(), t));
+        }
+        std::vector<metrics::call_site_stats> snapshot()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto totals = current();
+            std::vector<metrics::call_site_stats> ret(sites);
+            for (size_t i = 0; i < ret.size(); ++i) {
+                ret[i].calls = totals[i].calls - baseline[i].calls;
+                ret[i].total_ns = totals[i].total_ns - baseline[i].total_ns;
+                for (size_t b = 0; b < metrics::histogram_buckets; ++b) {
+                    ret[i].histogram[b] = totals[i].histogram[b] - baseline[i].histogram[b];
+                }
+            }
+            return ret;
+        }
+        //! slots are single-writer, so reset() moves the baseline instead of clearing them.
+        void reset()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            baseline = current();
+        }
+
+    private:
+        metrics_registry() = default;
+
+        std::vector<metrics_counter> current() const
+        {
+            auto ret = retired;
+            for (auto t : threads) {
+                collect(t, ret);
+            }
+            return ret;
+        }
+        static void collect(const metrics_thread_slots* t, std::vector<metrics_counter>& out)
+        {
+            for (size_t c = 0; c < metrics_max_chunks && c * metrics_chunk_size < out.size(); ++c) {
+                auto p = t->chunks[c].load(std::memory_order_acquire);
+                if (!p) continue;
+                for (size_t i = 0; i < metrics_chunk_size && c * metrics_chunk_size + i < out.size(); ++i) {
+                    p->slots[i].add_to(out[c * metrics_chunk_size + i]);
+                }
+            }
+        }
+
+        std::mutex mutex;
+        std::map<std::string, metrics::call_site_id> index;
+        std::vector<metrics::call_site_stats> sites;
+        std::vector<metrics_counter> retired;
+        std::vector<metrics_counter> baseline;
+        std::vector<metrics_thread_slots*> threads;
+    };
+
+    inline metrics_thread_slots::metrics_thread_slots()
+    {
+        metrics_registry::instance().attach(this);
+    }
+    inline metrics_thread_slots::~metrics_thread_slots()
+    {
+        metrics_registry::instance().detach(this);
+        for (auto&& c : chunks) {
+            delete c.load(std::memory_order_relaxed);
+        }
+    }
+
+    //! measures one call through a wrapper.
+    class call_site_timer
+    {
+    public:
+        explicit call_site_timer(metrics::call_site_id id) noexcept : id(id)
+        {
+            if (id != metrics::invalid_call_site) start = std::chrono::steady_clock::now();
+        }
+        ~call_site_timer()
+        {
+            if (id == metrics::invalid_call_site) return;
+            const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            thread_local metrics_thread_slots slots;
+            if (auto p = slots.slot(id)) p->record(static_cast<std::uint64_t>(ns));
+        }
+    private:
+        metrics::call_site_id id;
+        std::chrono::steady_clock::time_point start;
+    };
+}
+
+namespace metrics
+{
+    //! key a call site by kind, class FQCN, name and JNI signature. the same key returns the same id.
+    inline call_site_id register_call_site(const char* kind, const char* className, const char* name, const char* signature)
+    {
+        return internal::metrics_registry::instance().register_call_site(kind, className, name, signature);
+    }
+    //! counts since the last reset(), summed over all threads (including exited ones).
+    inline std::vector<call_site_stats> snapshot()
+    {
+        return internal::metrics_registry::instance().snapshot();
+    }
+    inline void reset()
+    {
+        internal::metrics_registry::instance().reset();
+    }
+}
+
+#define UC_JNI_CALL_SITE_MEMBER metrics::call_site_id site = metrics::invalid_call_site;
+#define UC_JNI_CALL_SITE_TIMER internal::call_site_timer call_site_timer_{site};
+#define UC_JNI_CALL_SITE(kind, className, name, signature) , metrics::register_call_site(#kind, className, name, signature)
+#else
+#define UC_JNI_CALL_SITE_MEMBER
+#define UC_JNI_CALL_SITE_TIMER
+#define UC_JNI_CALL_SITE(kind, className, name, signature)
+#endif
+
+
+//*************************************************************************************************
+// Accessing Fields
+//*************************************************************************************************
+
+template<typename JType, typename T> struct field
+{
+    template<typename JObj> decltype(auto) get(const JObj& obj) const
+    {
+        return load(env(), obj);
+    }
+    template<typename JObj, typename U> void set(const JObj& obj, const U& value) const
+    {
+        set(env(), obj, value);
+    }
+    template<typename JObj> decltype(auto) get(JNIEnv* e, const JObj& obj) const
+    {
+        return internal::in_env(e, load(e, obj));
+    }
+    template<typename JObj, typename U> void set(JNIEnv* e, const JObj& obj, const U& value) const
+    {
+        UC_JNI_CALL_SITE_TIMER
+        function_traits<typename type_traits<T>::jvalue_type>::set_field(e, jni::to_native_ref(obj), id, type_traits<T>::j_cast(value));
+    }
+    jfieldID id{};
+    UC_JNI_CALL_SITE_MEMBER
+
+private:
+    template<typename JObj> decltype(auto) load(JNIEnv* e, const JObj& obj) const
+    {
+        UC_JNI_CALL_SITE_TIMER
+        return internal::adopt_cast<T>(e, function_traits<typename type_traits<T>::jvalue_type>::get_field(e, jni::to_native_ref(obj), id), nullptr);
+    }
+};
+template <typename JType, typename T> field<JType, T> make_field(const char* name)
+{
+    return field<JType, T>{ get_field_id<JType, T>(name) UC_JNI_CALL_SITE(field, fqcn<JType>(), name, get_signature<T>()) };
+}
+
+//*************************************************************************************************
+// Accessing Static Fields
+//*************************************************************************************************
+
+namespace internal
+{
+    //! the class of a static member or non-virtual call, resolved ahead by the caller (see the wrapper class macros).
+    struct bound_class
+    {
+        jclass cls;
+    };
+}
+
+template<typename JType, typename T> struct static_field
+{
+    decltype(auto) get() const
+    {
+        return load(env(), get_class<JType>());
+    }
+    template<typename U> void set(const U& value) const
+    {
+        store(env(), get_class<JType>(), value);
+    }
+    decltype(auto) get(JNIEnv* e) const
+    {
+        return internal::in_env(e, load(e, get_class<JType>()));
+    }
+    template<typename U> void set(JNIEnv* e, const U& value) const
+    {
+        store(e, get_class<JType>(), value);
+    }
+    decltype(auto) get(internal::bound_class c) const
+    {
+        return load(env(), c.cls);
+    }
+    template<typename U> void set(internal::bound_class c, const U& value) const
+    {
+        store(env(), c.cls, value);
+    }
+    jfieldID id{};
+    UC_JNI_CALL_SITE_MEMBER
+
+private:
+    decltype(auto) load(JNIEnv* e, jclass cls) const
+    {
+        UC_JNI_CALL_SITE_TIMER
+        return internal::adopt_cast<T>(e, function_traits<typename type_traits<T>::jvalue_type>::get_static_field(e, cls, id), nullptr);
+    }
+    template<typename U> void store(JNIEnv* e, jclass cls, const U& value) const
+    {
+        UC_JNI_CALL_SITE_TIMER
+        function_traits<typename type_traits<T>::jvalue_type>::set_static_field(e, cls, id, type_traits<T>::j_cast(value));
+    }
+};
+template <typename JType, typename T> static_field<JType, T> make_static_field(const char* name)
+{
+    return static_field<JType, T>{ get_static_field_id<JType, T>(name) UC_JNI_CALL_SITE(static_field, fqcn<JType>(), name, get_signature<T>()) };
+}
+
+//*************************************************************************************************
+// Calling Instance Methods
 //*************************************************************************************************
 
 template <typename...> struct method;
@@ -1056,26 +2687,44 @@ template <typename JType, typename... Args> struct method<JType, void(Args...)>
 {
     template<typename JObj, typename... Ts> void operator()(const JObj& obj, const Ts&... args) const
     {
-        function_traits<void>::call_method(env(), to_native_ref(obj), id, type_traits<Args>::j_cast(args)...);
-        exception_check();
+        call(env(), obj, args...);
+    }
+    template<typename JObj, typename... Ts> void call(JNIEnv* e, const JObj& obj, const Ts&... args) const
+    {
+        UC_JNI_CALL_SITE_TIMER
+        function_traits<void>::call_method(e, to_native_ref(obj), id, type_traits<Args>::j_cast(args)...);
+        exception_check(e);
     }
 
     jmethodID id{};
+    UC_JNI_CALL_SITE_MEMBER
 };
 template <typename JType, typename R, typename... Args> struct method<JType, R(Args...)> 
 {
     template<typename JObj, typename... Ts> decltype(auto) operator()(const JObj& obj, const Ts&... args) const
     {
-        auto result = function_traits<typename type_traits<R>::jvalue_type>::call_method(env(), to_native_ref(obj), id, type_traits<Args>::j_cast(args)...);
-        exception_check();
-        return type_traits<R>::c_cast(result);
+        return invoke(env(), obj, args...);
+    }
+    template<typename JObj, typename... Ts> decltype(auto) call(JNIEnv* e, const JObj& obj, const Ts&... args) const
+    {
+        return internal::in_env(e, invoke(e, obj, args...));
     }
 
     jmethodID id{};
+    UC_JNI_CALL_SITE_MEMBER
+
+private:
+    template<typename JObj, typename... Ts> decltype(auto) invoke(JNIEnv* e, const JObj& obj, const Ts&... args) const
+    {
+        UC_JNI_CALL_SITE_TIMER
+        auto result = function_traits<typename type_traits<R>::jvalue_type>::call_method(e, to_native_ref(obj), id, type_traits<Args>::j_cast(args)...);
+        exception_check(e);
+        return internal::adopt_cast<R>(e, result, nullptr);
+    }
 };
 template <typename JType, typename Fun> method<JType, Fun> make_method(const char* name)
 {
-    return method<JType, Fun>{ get_method_id<JType, Fun>(name) };
+    return method<JType, Fun>{ get_method_id<JType, Fun>(name) UC_JNI_CALL_SITE(method, fqcn<JType>(), name, get_signature<Fun>()) };
 }
 
 
@@ -1084,26 +2733,58 @@ template <typename JType, typename... Args> struct non_virtual_method<JType, voi
 {
     template<typename JObj, typename... Ts> void operator()(const JObj& obj, const Ts&... args) const
     {
-        function_traits<void>::call_non_virtual_method(env(), to_native_ref(obj), get_class<JType>(), id, type_traits<Args>::j_cast(args)...);
-        exception_check();
+        invoke(env(), get_class<JType>(), obj, args...);
+    }
+    template<typename JObj, typename... Ts> void call(JNIEnv* e, const JObj& obj, const Ts&... args) const
+    {
+        invoke(e, get_class<JType>(), obj, args...);
+    }
+    template<typename JObj, typename... Ts> void operator()(internal::bound_class c, const JObj& obj, const Ts&... args) const
+    {
+        invoke(env(), c.cls, obj, args...);
     }
 
     jmethodID id{};
+    UC_JNI_CALL_SITE_MEMBER
+
+private:
+    template<typename JObj, typename... Ts> void invoke(JNIEnv* e, jclass cls, const JObj& obj, const Ts&... args) const
+    {
+        UC_JNI_CALL_SITE_TIMER
+        function_traits<void>::call_non_virtual_method(e, to_native_ref(obj), cls, id, type_traits<Args>::j_cast(args)...);
+        exception_check(e);
+    }
 };
 template <typename JType, typename R, typename... Args> struct non_virtual_method<JType, R(Args...)> 
 {
     template<typename JObj, typename... Ts> decltype(auto) operator()(const JObj& obj, const Ts&... args) const
     {
-        auto result = function_traits<typename type_traits<R>::jvalue_type>::call_non_virtual_method(env(), to_native_ref(obj), get_class<JType>(), id, type_traits<Args>::j_cast(args)...);
-        exception_check();
-        return type_traits<R>::c_cast(result);
+        return invoke(env(), get_class<JType>(), obj, args...);
+    }
+    template<typename JObj, typename... Ts> decltype(auto) call(JNIEnv* e, const JObj& obj, const Ts&... args) const
+    {
+        return internal::in_env(e, invoke(e, get_class<JType>(), obj, args...));
+    }
+    template<typename JObj, typename... Ts> decltype(auto) operator()(internal::bound_class c, const JObj& obj, const Ts&... args) const
+    {
+        return invoke(env(), c.cls, obj, args...);
     }
 
     jmethodID id{};
+    UC_JNI_CALL_SITE_MEMBER
+
+private:
+    template<typename JObj, typename... Ts> decltype(auto) invoke(JNIEnv* e, jclass cls, const JObj& obj, const Ts&... args) const
+    {
+        UC_JNI_CALL_SITE_TIMER
+        auto result = function_traits<typename type_traits<R>::jvalue_type>::call_non_virtual_method(e, to_native_ref(obj), cls, id, type_traits<Args>::j_cast(args)...);
+        exception_check(e);
+        return internal::adopt_cast<R>(e, result, nullptr);
+    }
 };
 template <typename JType, typename Fun> non_virtual_method<JType, Fun> make_non_virtual_method(const char* name)
 {
-    return non_virtual_method<JType, Fun>{ get_method_id<JType, Fun>(name) };
+    return non_virtual_method<JType, Fun>{ get_method_id<JType, Fun>(name) UC_JNI_CALL_SITE(non_virtual_method, fqcn<JType>(), name, get_signature<Fun>()) };
 }
 
 //*************************************************************************************************
@@ -1115,26 +2796,58 @@ template <typename JType, typename... Args> struct static_method<JType, void(Arg
 {
     template<typename... Ts> void operator()(const Ts&... args) const
     {
-        function_traits<void>::call_static_method(env(), get_class<JType>(), id, type_traits<Args>::j_cast(args)...);
-        exception_check();
+        invoke(env(), get_class<JType>(), args...);
+    }
+    template<typename... Ts> void call(JNIEnv* e, const Ts&... args) const
+    {
+        invoke(e, get_class<JType>(), args...);
+    }
+    template<typename... Ts> void operator()(internal::bound_class c, const Ts&... args) const
+    {
+        invoke(env(), c.cls, args...);
     }
 
     jmethodID id{};
+    UC_JNI_CALL_SITE_MEMBER
+
+private:
+    template<typename... Ts> void invoke(JNIEnv* e, jclass cls, const Ts&... args) const
+    {
+        UC_JNI_CALL_SITE_TIMER
+        function_traits<void>::call_static_method(e, cls, id, type_traits<Args>::j_cast(args)...);
+        exception_check(e);
+    }
 };
 template <typename JType, typename R, typename... Args> struct static_method<JType, R(Args...)>
 {
     template<typename... Ts> decltype(auto) operator()(const Ts&... args) const
     {
-        auto result = function_traits<typename type_traits<R>::jvalue_type>::call_static_method(env(), get_class<JType>(), id, type_traits<Args>::j_cast(args)...);
-        exception_check();
-        return type_traits<R>::c_cast(result);
+        return invoke(env(), get_class<JType>(), args...);
+    }
+    template<typename... Ts> decltype(auto) call(JNIEnv* e, const Ts&... args) const
+    {
+        return internal::in_env(e, invoke(e, get_class<JType>(), args...));
+    }
+    template<typename... Ts> decltype(auto) operator()(internal::bound_class c, const Ts&... args) const
+    {
+        return invoke(env(), c.cls, args...);
     }
 
     jmethodID id{};
+    UC_JNI_CALL_SITE_MEMBER
+
+private:
+    template<typename... Ts> decltype(auto) invoke(JNIEnv* e, jclass cls, const Ts&... args) const
+    {
+        UC_JNI_CALL_SITE_TIMER
+        auto result = function_traits<typename type_traits<R>::jvalue_type>::call_static_method(e, cls, id, type_traits<Args>::j_cast(args)...);
+        exception_check(e);
+        return internal::adopt_cast<R>(e, result, nullptr);
+    }
 };
 template <typename JType, typename Fun> static_method<JType, Fun> make_static_method(const char* name)
 {
-    return static_method<JType, Fun>{ get_static_method_id<JType, Fun>(name) };
+    return static_method<JType, Fun>{ get_static_method_id<JType, Fun>(name) UC_JNI_CALL_SITE(static_method, fqcn<JType>(), name, get_signature<Fun>()) };
 }
 
 
@@ -1145,25 +2858,194 @@ template <typename JType, typename Fun> static_method<JType, Fun> make_static_me
 template <typename...> struct constructor;
 template <typename JType, typename... Args> struct constructor<JType(Args...)> 
 {
+    using class_type = JType;
+    using signature_type = void(Args...);
     static jmethodID get_id()
     {
-        return get_method_id<JType, void(Args...)>("<init>");
+        return get_method_id<JType, signature_type>("<init>");
     }
     template<typename... Ts> local_ref<JType> operator()(const Ts&... args) const
     {
-        auto result = env()->NewObject(get_class<JType>(), id, to_native_ref(type_traits<Args>::j_cast(args))...);
-        exception_check();
-        return local_ref<JType>{ static_cast<JType>(result) };
+        return invoke(env(), get_class<JType>(), args...);
+    }
+    template<typename... Ts> local_ref_in<JType> call(JNIEnv* e, const Ts&... args) const
+    {
+        return internal::in_env(e, invoke(e, get_class<JType>(), args...));
+    }
+    template<typename... Ts> local_ref<JType> operator()(internal::bound_class c, const Ts&... args) const
+    {
+        return invoke(env(), c.cls, args...);
     }
 
     jmethodID id{};
+    UC_JNI_CALL_SITE_MEMBER
+
+private:
+    template<typename... Ts> local_ref<JType> invoke(JNIEnv* e, jclass cls, const Ts&... args) const
+    {
+        UC_JNI_CALL_SITE_TIMER
+        auto result = e->NewObject(cls, id, to_native_ref(type_traits<Args>::j_cast(args))...);
+        exception_check(e);
+        return internal::adopt_local(static_cast<JType>(result));
+    }
 };
 template <typename Fun> constructor<Fun> make_constructor()
 {
-    return constructor<Fun>{ constructor<Fun>::get_id() };
+    using ctor = constructor<Fun>;
+    return ctor{ ctor::get_id() UC_JNI_CALL_SITE(constructor, fqcn<typename ctor::class_type>(), "<init>", get_signature<typename ctor::signature_type>()) };
 }
 
 
+//*************************************************************************************************
+// Object Pools
+//*************************************************************************************************
+
+//! pre-constructed Java objects held by global references, for results that hot paths refill instead of allocating.
+//! reset runs when an object comes back, typically through UC_JNI_DEFINE_JCLASS_FIELD setters.
+//! an object handed to Java must not be touched by Java after it is released back to the pool.
+//! a lease may outlive its pool; its object is then deleted instead of recycled.
+template <typename JType> class object_pool
+{
+    class state;
+public:
+    using factory_type = std::function<local_ref<JType>()>;
+    using reset_type = std::function<void(JType)>;
+
+    //! returns the object to the pool on destruction.
+    class lease
+    {
+    public:
+        lease() noexcept = default;
+        lease(lease&&) noexcept = default;
+        lease& operator=(lease&& x) noexcept
+        {
+            lease(std::move(x)).swap(*this);
+            return *this;
+        }
+        ~lease()
+        {
+            if (!ref_) return;
+            if (auto pool = pool_.lock()) pool->recycle(std::move(ref_));
+        }
+        void swap(lease& x) noexcept
+        {
+            pool_.swap(x.pool_);
+            ref_.swap(x.ref_);
+        }
+        explicit operator bool() const noexcept
+        {
+            return static_cast<bool>(ref_);
+        }
+        JType get() const noexcept
+        {
+            return ref_.get();
+        }
+        JType operator->() const noexcept
+        {
+            return ref_.get();
+        }
+        //! the object leaves the pool (e.g. Java keeps it). pass it back with object_pool::recycle() if Java returns it.
+        unique_global_ref<JType> release() noexcept
+        {
+            return std::move(ref_);
+        }
+    private:
+        friend class object_pool;
+        lease(const std::shared_ptr<state>& pool, unique_global_ref<JType> ref) noexcept : pool_(pool), ref_(std::move(ref))
+        {
+        }
+        std::weak_ptr<state> pool_;
+        unique_global_ref<JType> ref_;
+    };
+
+    //! keeps at most capacity idle objects; prefill of them are constructed now.
+    explicit object_pool(factory_type factory, reset_type reset = nullptr, std::size_t capacity = 64, std::size_t prefill = 0)
+        : state_(std::make_shared<state>(std::move(factory), std::move(reset), capacity))
+    {
+        for (std::size_t i = 0; i < std::min(prefill, capacity); ++i) {
+            state_->idle.push_back(state_->create());
+        }
+    }
+    object_pool(const object_pool&) = delete;
+    object_pool& operator=(const object_pool&) = delete;
+
+    //! an idle object, or a new one if none is idle.
+    lease acquire()
+    {
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            if (!state_->idle.empty()) {
+                auto ref = std::move(state_->idle.back());
+                state_->idle.pop_back();
+                return lease(state_, std::move(ref));
+            }
+        }
+        return lease(state_, state_->create());
+    }
+    //! resets obj and keeps it if there is room. objects that fail to reset are dropped.
+    void recycle(unique_global_ref<JType> obj) noexcept
+    {
+        state_->recycle(std::move(obj));
+    }
+    //! objects waiting in the pool.
+    std::size_t idle() const
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->idle.size();
+    }
+    //! objects the factory has constructed.
+    std::size_t created() const
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->created;
+    }
+
+private:
+    //! shared with the leases, which hold it weakly.
+    class state
+    {
+    public:
+        state(factory_type factory, reset_type reset, std::size_t capacity)
+            : factory(std::move(factory)), reset(std::move(reset)), capacity(capacity)
+        {
+            idle.reserve(capacity);
+        }
+        unique_global_ref<JType> create()
+        {
+            auto ref = make_unique_global(factory());
+            if (!ref) throw std::runtime_error("uc::jni::object_pool : factory returned null");
+            std::lock_guard<std::mutex> lock(mutex);
+            ++created;
+            return ref;
+        }
+        void recycle(unique_global_ref<JType> obj) noexcept
+        {
+            if (!obj) return;
+            if (reset) {
+                try {
+                    reset(obj.get());
+                } catch (...) {
+                    auto e = env();
+                    if (e->ExceptionCheck()) e->ExceptionClear();
+                    return;
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (idle.size() < capacity) idle.push_back(std::move(obj));
+        }
+
+        const factory_type factory;
+        const reset_type reset;
+        const std::size_t capacity;
+        std::mutex mutex;
+        std::vector<unique_global_ref<JType>> idle;
+        std::size_t created = 0;
+    };
+
+    std::shared_ptr<state> state_;
+};
+
+
 //*************************************************************************************************
 // Monitor Operations
 //*************************************************************************************************
@@ -1182,23 +3064,278 @@ template <typename JType> monitor<native_ref<JType>> synchronized(const JType& o
     return monitor<native_ref<JType>>(to_native_ref(obj));
 }
 
-
-//*************************************************************************************************
-// Registering Native Methods (Beta)
-//*************************************************************************************************
-template<typename R, typename... Args> JNINativeMethod make_native_method(const char* name, R(*fnPtr)(JNIEnv*,jobject,Args...)) noexcept
+//! System.identityHashCode(obj). it does not change while obj lives, so compute it once and keep it with the native state.
+template <typename JType> jint identity_hash(const JType& obj)
 {
-    return JNINativeMethod { name, get_signature<R(Args...)>(), (void*)fnPtr };
+    static const auto system = make_global(find_class("java/lang/System"));
+    static const auto identityHashCode = env()->GetStaticMethodID(system.get(), "identityHashCode", "(Ljava/lang/Object;)I");
+    const auto hash = env()->CallStaticIntMethod(system.get(), identityHashCode, to_native_ref(obj));
+    exception_check();
+    return hash;
 }
 
-template <typename JType> bool register_natives(const JNINativeMethod* methods, jint nMethods)
-{
-    return env()->RegisterNatives(get_class<JType>(), methods, nMethods) == 0;
-}
-template <typename JType, size_t N> bool register_natives(const JNINativeMethod (&methods)[N])
+//*************************************************************************************************
+// Identity Locks (define UC_JNI_ENABLE_IDENTITY_LOCKS)
+//*************************************************************************************************
+#ifdef UC_JNI_ENABLE_IDENTITY_LOCKS
+//! striped reader-writer locks keyed by object identity, for critical sections that guard only native state.
+//! unlike synchronized(), locking with a stored identity_hash() makes no JNI call, and shared guards do not exclude each other.
+//! different objects may share a stripe: do not hold guards of two objects at once.
+class identity_lock_table
 {
-    return register_natives<JType>(methods, N);
-}
+public:
+    using mutex_type = std::shared_timed_mutex;
+
+    //! stripes is rounded up to a power of 2.
+    explicit identity_lock_table(std::size_t stripes = 64)
+    {
+        std::size_t size = 1;
+        while (size < stripes) size *= 2;
+        // operator new[] does not honor extended alignment before C++17, so align the stripes by hand.
+        std::size_t space = sizeof(stripe) * size + alignof(stripe) - 1;
+        storage_.reset(new char[space]);
+        void* p = storage_.get();
+        stripes_ = static_cast<stripe*>(std::align(alignof(stripe), sizeof(stripe) * size, p, space));
+        for (std::size_t i = 0; i < size; ++i) new (stripes_ + i) stripe();
+        mask_ = size - 1;
+    }
+    ~identity_lock_table()
+    {
+        for (std::size_t i = 0; i <= mask_; ++i) stripes_[i].~stripe();
+    }
+    identity_lock_table(const identity_lock_table&) = delete;
+    identity_lock_table& operator=(const identity_lock_table&) = delete;
+
+    mutex_type& mutex(jint hash) const noexcept
+    {
+        // spread hashes that differ only in the high bits.
+        auto h = static_cast<std::uint32_t>(hash);
+        h = (h ^ (h >> 16)) * 0x45d9f3bu;
+        return stripes_[(h ^ (h >> 16)) & mask_].mutex;
+    }
+    std::shared_lock<mutex_type> shared(jint hash) const
+    {
+        return std::shared_lock<mutex_type>(mutex(hash));
+    }
+    std::unique_lock<mutex_type> exclusive(jint hash) const
+    {
+        return std::unique_lock<mutex_type>(mutex(hash));
+    }
+    //! calls identity_hash() every time.
+    template <typename JType, std::enable_if_t<is_derived_from_jobject<native_ref<JType>>::value, std::nullptr_t> = nullptr>
+    std::shared_lock<mutex_type> shared(const JType& obj) const
+    {
+        return shared(identity_hash(obj));
+    }
+    template <typename JType, std::enable_if_t<is_derived_from_jobject<native_ref<JType>>::value, std::nullptr_t> = nullptr>
+    std::unique_lock<mutex_type> exclusive(const JType& obj) const
+    {
+        return exclusive(identity_hash(obj));
+    }
+
+private:
+    //! one stripe per cache line, so neighbouring stripes do not false-share.
+    struct alignas(64) stripe
+    {
+        mutex_type mutex;
+    };
+    std::unique_ptr<char[]> storage_;
+    stripe* stripes_;
+    std::size_t mask_;
+};
+
+//! the process-wide table (256 stripes).
+inline identity_lock_table& identity_locks()
+{
+    static auto table = new identity_lock_table(256);
+    return *table;
+}
+#endif
+
+
+//*************************************************************************************************
+// Identity Maps (define UC_JNI_ENABLE_IDENTITY_MAP)
+//*************************************************************************************************
+#ifdef UC_JNI_ENABLE_IDENTITY_MAP
+//! concurrent native side table keyed by object identity. keys are held through weak global references,
+//! so an entry does not keep its key alive. entries whose keys have been collected are purged incrementally
+//! by insertions (a stripe is swept each time it doubles in size), or all at once by purge().
+template <typename JType, typename V> class identity_map
+{
+public:
+    using key_type = JType;
+    using mapped_type = V;
+
+    //! stripes is rounded up to a power of 2.
+    explicit identity_map(std::size_t stripes = 16)
+    {
+        std::size_t size = 1;
+        while (size < stripes) size *= 2;
+        stripes_.reset(new stripe[size]);
+        mask_ = size - 1;
+    }
+    identity_map(const identity_map&) = delete;
+    identity_map& operator=(const identity_map&) = delete;
+
+    //! copies the value into "value". returns false if key is not in the map.
+    template <typename T> bool find(const T& key, V& value) const
+    {
+        return find(identity_hash(key), key, value);
+    }
+    //! hash : identity_hash(key), computed once and kept with the native state.
+    template <typename T> bool find(jint hash, const T& key, V& value) const
+    {
+        auto& s = stripe_of(hash);
+        std::shared_lock<std::shared_timed_mutex> lock(s.mutex);
+        const auto itr = s.lookup(hash, key);
+        if (itr == s.entries.end()) return false;
+        value = itr->second.value;
+        return true;
+    }
+    template <typename T> bool contains(const T& key) const
+    {
+        const auto hash = identity_hash(key);
+        auto& s = stripe_of(hash);
+        std::shared_lock<std::shared_timed_mutex> lock(s.mutex);
+        return s.lookup(hash, key) != s.entries.end();
+    }
+    //! returns the value for key, calling make() outside the lock to create it on a miss.
+    //! when two threads miss at once, the first insertion wins and both return its value.
+    template <typename T, typename F> V get_or_insert(const T& key, F&& make)
+    {
+        return get_or_insert(identity_hash(key), key, std::forward<F>(make));
+    }
+    template <typename T, typename F> V get_or_insert(jint hash, const T& key, F&& make)
+    {
+        V value;
+        if (find(hash, key, value)) return value;
+        value = make();
+        auto& s = stripe_of(hash);
+        std::unique_lock<std::shared_timed_mutex> lock(s.mutex);
+        const auto itr = s.lookup(hash, key);
+        if (itr != s.entries.end()) return itr->second.value;
+        s.insert(hash, key, value);
+        return value;
+    }
+    template <typename T> void insert_or_assign(const T& key, V value)
+    {
+        const auto hash = identity_hash(key);
+        auto& s = stripe_of(hash);
+        std::unique_lock<std::shared_timed_mutex> lock(s.mutex);
+        const auto itr = s.lookup(hash, key);
+        if (itr != s.entries.end()) {
+            itr->second.value = std::move(value);
+        } else {
+            s.insert(hash, key, std::move(value));
+        }
+    }
+    //! returns false if key is not in the map.
+    template <typename T> bool erase(const T& key)
+    {
+        const auto hash = identity_hash(key);
+        auto& s = stripe_of(hash);
+        std::unique_lock<std::shared_timed_mutex> lock(s.mutex);
+        const auto itr = s.lookup(hash, key);
+        if (itr == s.entries.end()) return false;
+        s.entries.erase(itr);
+        return true;
+    }
+    //! removes every entry whose key has been collected. returns the number removed.
+    std::size_t purge()
+    {
+        std::size_t count = 0;
+        for (std::size_t i = 0; i <= mask_; ++i) {
+            std::unique_lock<std::shared_timed_mutex> lock(stripes_[i].mutex);
+            count += stripes_[i].purge();
+        }
+        return count;
+    }
+    //! entries in the map, including those whose keys have been collected but not purged yet.
+    std::size_t size() const
+    {
+        std::size_t count = 0;
+        for (std::size_t i = 0; i <= mask_; ++i) {
+            std::shared_lock<std::shared_timed_mutex> lock(stripes_[i].mutex);
+            count += stripes_[i].entries.size();
+        }
+        return count;
+    }
+
+private:
+    struct entry
+    {
+        unique_weak_ref<JType> key;
+        V value;
+    };
+    struct stripe
+    {
+        using map_type = std::unordered_multimap<jint, entry>;
+
+        template <typename T> typename map_type::iterator lookup(jint hash, const T& key)
+        {
+            const auto range = entries.equal_range(hash);
+            for (auto itr = range.first; itr != range.second; ++itr) {
+                if (itr->second.key.is_same(key)) return itr;
+            }
+            return entries.end();
+        }
+        template <typename T> void insert(jint hash, const T& key, V value)
+        {
+            if (entries.size() >= purge_at) {
+                purge();
+                purge_at = std::max<std::size_t>(16, entries.size() * 2);
+            }
+            entries.emplace(hash, entry{ unique_weak_ref<JType>(key), std::move(value) });
+        }
+        std::size_t purge()
+        {
+            std::size_t count = 0;
+            for (auto itr = entries.begin(); itr != entries.end();) {
+                if (itr->second.key.expired()) {
+                    itr = entries.erase(itr);
+                    ++count;
+                } else {
+                    ++itr;
+                }
+            }
+            return count;
+        }
+
+        mutable std::shared_timed_mutex mutex;
+        map_type entries;
+        std::size_t purge_at = 16;
+    };
+
+    stripe& stripe_of(jint hash) const noexcept
+    {
+        auto h = static_cast<std::uint32_t>(hash);
+        h = (h ^ (h >> 16)) * 0x45d9f3bu;
+        return stripes_[(h ^ (h >> 16)) & mask_];
+    }
+
+    std::unique_ptr<stripe[]> stripes_;
+    std::size_t mask_;
+};
+#endif
+
+
+//*************************************************************************************************
+// Registering Native Methods (Beta)
+//*************************************************************************************************
+//! JNINativeMethod::name/signature are "char*" in OpenJDK's jni.h and "const char*" in Android's.
+template<typename R, typename... Args> JNINativeMethod make_native_method(const char* name, R(*fnPtr)(JNIEnv*,jobject,Args...)) noexcept
+{
+    return JNINativeMethod { const_cast<char*>(name), const_cast<char*>(get_signature<R(Args...)>()), (void*)fnPtr };
+}
+
+template <typename JType> bool register_natives(const JNINativeMethod* methods, jint nMethods)
+{
+    return env()->RegisterNatives(get_class<JType>(), methods, nMethods) == 0;
+}
+template <typename JType, size_t N> bool register_natives(const JNINativeMethod (&methods)[N])
+{
+    return register_natives<JType>(methods, N);
+}
 
 
 //*************************************************************************************************
@@ -1206,9 +3343,11 @@ template <typename JType, size_t N> bool register_natives(const JNINativeMethod
 //*************************************************************************************************
 // UC_JNI_DEFINE_JCLASS_ALIAS(DirectByteBuffer, java/nio/DirectByteBuffer);
 
+//! counted by copy_stats as "direct_buffer" bytes. new_direct_buffer<T>() goes through here too.
 inline local_ref<jobject> new_direct_byte_buffer(void* address, jlong capacity) noexcept
 {
-    return local_ref<jobject>{ env()->NewDirectByteBuffer(address, capacity) };
+    UC_JNI_COPY_STATS(internal::record_copy<jbyte>(internal::copy_direct_buffer, internal::copy_to_java, static_cast<size_t>(capacity), false);)
+    return internal::adopt_local(env()->NewDirectByteBuffer(address, capacity));
 }
 
 
@@ -1217,6 +3356,7 @@ template<typename T> struct direct_buffer_deleter
     void operator()(jobject obj) const noexcept
     {
         std::default_delete<T[]>()(static_cast<T*>(env()->GetDirectBufferAddress(obj)));
+        UC_JNI_REF_STATS(if (obj) internal::ref_counter<direct_buffer_deleter<T>>().delete_global();)
         env()->DeleteGlobalRef(obj);
     }
 };
@@ -1229,7 +3369,9 @@ template <typename T> direct_buffer<T> new_direct_buffer(size_t size)
     exception_check();
     if (!buf) throw std::runtime_error("uc::jni::new_direct_buffer");
     address.release();
-    return direct_buffer<T>(env()->NewGlobalRef(buf.get()));
+    auto ref = env()->NewGlobalRef(buf.get());
+    UC_JNI_REF_STATS(if (ref) internal::ref_counter<direct_buffer_deleter<T>>().new_global();)
+    return direct_buffer<T>(ref);
 }
 template <typename T> size_t length(const direct_buffer<T>& obj) noexcept
 {
@@ -1248,8 +3390,160 @@ template <typename T> T* address(const direct_buffer<T>& obj) noexcept
 namespace internal
 {
     template<typename ...Args> using native_arguments_type = std::tuple<typename type_traits<std::decay_t<Args>>::jvalue_type...>;
+
+    //! method and field IDs declared by the wrapper class macros, listed per class so that a class resolves them in one pass.
+    class id_registry
+    {
+    public:
+        //! returns true if the call published the ID.
+        using resolver_type = bool (*)();
+
+        static id_registry& instance()
+        {
+            static auto registry = new id_registry();
+            return *registry;
+        }
+        template <typename JType> bool add(resolver_type resolver)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries_.push_back(entry{ key<JType>(), resolver });
+            return true;
+        }
+        //! key : nullptr resolves every class. returns the number of IDs this call published.
+        std::size_t resolve(const void* key)
+        {
+            std::vector<resolver_type> resolvers;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (auto&& e : entries_) {
+                    if (!key || e.key == key) resolvers.push_back(e.resolver);
+                }
+            }
+            std::size_t count = 0;
+            for (auto resolver : resolvers) {
+                if (resolver()) ++count;
+            }
+            return count;
+        }
+        template <typename JType> static const void* key() noexcept
+        {
+            static const char instance = 0;
+            return &instance;
+        }
+
+    private:
+        struct entry
+        {
+            const void* key;
+            resolver_type resolver;
+        };
+        std::mutex mutex_;
+        std::vector<entry> entries_;
+    };
+
+    //! what an ID slot holds: the accessor, and the class that static and non-virtual calls pass to JNI.
+    template <typename Accessor> struct bound_accessor
+    {
+        Accessor accessor;
+        jclass cls;
+    };
+
+    //! storage of one ID declared by a wrapper class macro. Tag provides class_type, accessor_type and make().
+    //! no lock is held while an ID is looked up: GetMethodID() may run <clinit>, which may call back into
+    //! another slot or this one. IDs are idempotent, so racing lookups publish the first result and drop the others.
+    //! once published, a call costs one load besides the JNI call itself.
+    template <typename Tag> struct id_slot
+    {
+        using value_type = bound_accessor<typename Tag::accessor_type>;
+
+        static const value_type& get()
+        {
+            (void)registered;
+            const auto p = value.load(std::memory_order_acquire);
+            return p ? *p : publish().first;
+        }
+        static bool resolve()
+        {
+            return !value.load(std::memory_order_acquire) && publish().second;
+        }
+        //! returns the published value, and whether this call published it.
+        static std::pair<const value_type&, bool> publish()
+        {
+            std::unique_ptr<const value_type> made(new value_type{ Tag::make(), get_class<typename Tag::class_type>() });
+            const value_type* expected = nullptr;
+            if (value.compare_exchange_strong(expected, made.get(), std::memory_order_acq_rel, std::memory_order_acquire)) {
+                return { *made.release(), true };
+            }
+            return { *expected, false };
+        }
+        static std::atomic<const value_type*> value;
+        static const bool registered;
+    };
+    template <typename Tag> std::atomic<const typename id_slot<Tag>::value_type*> id_slot<Tag>::value{ nullptr };
+    template <typename Tag> const bool id_slot<Tag>::registered = id_registry::instance().add<typename Tag::class_type>(&id_slot<Tag>::resolve);
+
+    //! how a wrapper class macro makes its accessor.
+    struct method_id_kind
+    {
+        template <typename JType, typename Sig> static method<JType, Sig> make(const char* name) { return make_method<JType, Sig>(name); }
+    };
+    struct non_virtual_method_id_kind
+    {
+        template <typename JType, typename Sig> static non_virtual_method<JType, Sig> make(const char* name) { return make_non_virtual_method<JType, Sig>(name); }
+    };
+    struct static_method_id_kind
+    {
+        template <typename JType, typename Sig> static static_method<JType, Sig> make(const char* name) { return make_static_method<JType, Sig>(name); }
+    };
+    struct field_id_kind
+    {
+        template <typename JType, typename T> static field<JType, T> make(const char* name) { return make_field<JType, T>(name); }
+    };
+    struct static_field_id_kind
+    {
+        template <typename JType, typename T> static static_field<JType, T> make(const char* name) { return make_static_field<JType, T>(name); }
+    };
+    template <typename Sig> struct constructor_signature;
+    template <typename... Args> struct constructor_signature<void(Args...)>
+    {
+        template <typename JType> using type = JType(Args...);
+    };
+    struct constructor_id_kind
+    {
+        template <typename JType, typename Sig> static constructor<typename constructor_signature<Sig>::template type<JType>> make(const char*)
+        {
+            return make_constructor<typename constructor_signature<Sig>::template type<JType>>();
+        }
+    };
+    //! the tag of one ID slot. a member is told apart by its kind, class and signature; Name returns its Java name
+    //! (the macros declare one such function per member, overloaded on the signature).
+    template <typename Kind, typename JType, typename Sig, const char* (*Name)(Sig*)> struct id_tag
+    {
+        using class_type = JType;
+        using accessor_type = decltype(Kind::template make<JType, Sig>(""));
+        static accessor_type make() { return Kind::template make<JType, Sig>(Name(nullptr)); }
+    };
 }
 
+//! resolves the class and the method and field IDs its wrapper macros declare (those the program uses)
+//! in one pass, e.g. in JNI_OnLoad(), so that no call pays for a lookup later.
+//! returns the number of IDs resolved by this call; 0 once they are all resolved.
+template <typename JType> std::size_t resolve_ids()
+{
+    get_class<JType>();
+    return internal::id_registry::instance().resolve(internal::id_registry::key<JType>());
+}
+//! resolve_ids() for every wrapper class.
+inline std::size_t resolve_all_ids()
+{
+    return internal::id_registry::instance().resolve(nullptr);
+}
+
+// slot of the member ID of a wrapper class. "name" is the function that returns the Java name of the member;
+// overloads of one name declared by any of the macros below, even on the same line, get their own slots.
+#define UC_JNI_ID_SLOT(kind, signature, name) \
+    uc::jni::internal::id_slot<uc::jni::internal::id_tag<uc::jni::internal::kind ## _id_kind, this_type, signature, name>>::get()
+
 // define type only.
 #define UC_JNI_DEFINE_JCLASS_ALIAS(className, fullyQualifiedClassName) \
     struct className ## _ : public std::remove_pointer_t<uc::jni::object> \
@@ -1267,6 +3561,7 @@ namespace internal
         using this_type = Derived*;\
         static constexpr decltype(auto) fqcn() noexcept {return #fullyQualifiedClassName;}\
         template<typename ...Args> static decltype(auto) new_(Args&&... args) { return Derived::construct(nullptr, std::forward<Args>(args)...); }\
+        static std::size_t resolve_ids() { return uc::jni::resolve_ids<this_type>(); }\
     };\
     struct className ## _;\
     using className = className ## _*;\
@@ -1283,39 +3578,31 @@ namespace internal
     {\
         return methodName ## NonVirtual_(nullptr, std::forward<Args>(args)...);\
     }\
-    private:\
-    template <typename ...Args> decltype(auto) methodName ## _(std::enable_if_t<std::is_constructible<uc::jni::internal::native_arguments_type<__VA_ARGS__>, uc::jni::internal::native_arguments_type<Args...>>::value, std::nullptr_t>, Args&&... args)\
-    {\
-        static const auto method = uc::jni::make_method<this_type, returnType(__VA_ARGS__)>(#methodName);\
-        return method(this, std::forward<Args>(args)...);\
-    }\
-    template <typename ...Args> decltype(auto) methodName ## NonVirtual_(std::enable_if_t<std::is_constructible<uc::jni::internal::native_arguments_type<__VA_ARGS__>, uc::jni::internal::native_arguments_type<Args...>>::value, std::nullptr_t>, Args&&... args)\
-    {\
-        static const auto method = uc::jni::make_non_virtual_method<this_type, returnType(__VA_ARGS__)>(#methodName);\
-        return method(this, std::forward<Args>(args)...);\
-    }
+    UC_JNI_DEFINE_JCLASS_OVERLOADED_METHOD(returnType, methodName, __VA_ARGS__)
 
 //! define overloaded method.
 #define UC_JNI_DEFINE_JCLASS_OVERLOADED_METHOD(returnType, methodName, ...) \
     private:\
+    static constexpr const char* methodName ## _id_name(returnType(*)(__VA_ARGS__)) noexcept { return #methodName; }\
     template <typename ...Args> decltype(auto) methodName ## _(std::enable_if_t<std::is_constructible<uc::jni::internal::native_arguments_type<__VA_ARGS__>, uc::jni::internal::native_arguments_type<Args...>>::value, std::nullptr_t>, Args&&... args)\
     {\
-        static const auto method = uc::jni::make_method<this_type, returnType(__VA_ARGS__)>(#methodName);\
-        return method(this, std::forward<Args>(args)...);\
+        UC_JNI_TRACE_SCOPE(#methodName, "upcall", uc::jni::fqcn<this_type>())\
+        return UC_JNI_ID_SLOT(method, returnType(__VA_ARGS__), &methodName ## _id_name).accessor(this, std::forward<Args>(args)...);\
     }\
     template <typename ...Args> decltype(auto) methodName ## NonVirtual_(std::enable_if_t<std::is_constructible<uc::jni::internal::native_arguments_type<__VA_ARGS__>, uc::jni::internal::native_arguments_type<Args...>>::value, std::nullptr_t>, Args&&... args)\
     {\
-        static const auto method = uc::jni::make_non_virtual_method<this_type, returnType(__VA_ARGS__)>(#methodName);\
-        return method(this, std::forward<Args>(args)...);\
+        UC_JNI_TRACE_SCOPE(#methodName, "upcall", uc::jni::fqcn<this_type>())\
+        const auto& slot = UC_JNI_ID_SLOT(non_virtual_method, returnType(__VA_ARGS__), &methodName ## _id_name);\
+        return slot.accessor(uc::jni::internal::bound_class{ slot.cls }, this, std::forward<Args>(args)...);\
     }
 
 //! define field accessor.
 #define UC_JNI_DEFINE_JCLASS_FIELD(valueType, fieldName) \
     private:\
+    static constexpr const char* fieldName ## _id_name(valueType*) noexcept { return #fieldName; }\
     static decltype(auto) fieldName ## _accessor()\
     {\
-        static const auto field = uc::jni::make_field<this_type, valueType>(#fieldName);\
-        return field;\
+        return UC_JNI_ID_SLOT(field, valueType, &fieldName ## _id_name).accessor;\
     }\
     public:\
     decltype(auto) fieldName() { return fieldName ## _accessor().get(this); }\
@@ -1332,11 +3619,14 @@ namespace internal
 
 //! define constructor method.  instead of this, call new_() function.
 #define UC_JNI_DEFINE_JCLASS_CONSTRUCTOR(...) \
+    private:\
+    static constexpr const char* uc_jni_constructor_id_name(void(*)(__VA_ARGS__)) noexcept { return "<init>"; }\
     public:\
     template <typename ...Args> static decltype(auto) construct(std::enable_if_t<std::is_constructible<uc::jni::internal::native_arguments_type<__VA_ARGS__>, uc::jni::internal::native_arguments_type<Args...>>::value, std::nullptr_t>, Args&&... args)\
     {\
-        static const auto ctor = uc::jni::make_constructor<this_type(__VA_ARGS__)>();\
-        return ctor(std::forward<Args>(args)...);\
+        UC_JNI_TRACE_SCOPE("<init>", "upcall", uc::jni::fqcn<this_type>())\
+        const auto& slot = UC_JNI_ID_SLOT(constructor, void(__VA_ARGS__), &uc_jni_constructor_id_name);\
+        return slot.accessor(uc::jni::internal::bound_class{ slot.cls }, std::forward<Args>(args)...);\
     }
 
 //! define static method.
@@ -1346,34 +3636,34 @@ namespace internal
     {\
         return methodName ## _(nullptr, std::forward<Args>(args)...);\
     }\
-    private:\
-    template <typename ...Args> static decltype(auto) methodName ## _(std::enable_if_t<std::is_constructible<uc::jni::internal::native_arguments_type<__VA_ARGS__>, uc::jni::internal::native_arguments_type<Args...>>::value, std::nullptr_t>, Args&&... args)\
-    {\
-        static const auto method = uc::jni::make_static_method<this_type, returnType(__VA_ARGS__)>(#methodName);\
-        return method(std::forward<Args>(args)...);\
-    }
-
+    UC_JNI_DEFINE_JCLASS_OVERLOADED_STATIC_METHOD(returnType, methodName, __VA_ARGS__)
 
 //! define overloaded static method.
 #define UC_JNI_DEFINE_JCLASS_OVERLOADED_STATIC_METHOD(returnType, methodName, ...) \
     private:\
+    static constexpr const char* methodName ## _id_name(returnType(*)(__VA_ARGS__)) noexcept { return #methodName; }\
     template <typename ...Args> static decltype(auto) methodName ## _(std::enable_if_t<std::is_constructible<uc::jni::internal::native_arguments_type<__VA_ARGS__>, uc::jni::internal::native_arguments_type<Args...>>::value, std::nullptr_t>, Args&&... args)\
     {\
-        static const auto method = uc::jni::make_static_method<this_type, returnType(__VA_ARGS__)>(#methodName);\
-        return method(std::forward<Args>(args)...);\
+        UC_JNI_TRACE_SCOPE(#methodName, "upcall", uc::jni::fqcn<this_type>())\
+        const auto& slot = UC_JNI_ID_SLOT(static_method, returnType(__VA_ARGS__), &methodName ## _id_name);\
+        return slot.accessor(uc::jni::internal::bound_class{ slot.cls }, std::forward<Args>(args)...);\
     }
 
 //! define static field accessor.
 #define UC_JNI_DEFINE_JCLASS_STATIC_FIELD(valueType, fieldName) \
     private:\
-    static decltype(auto) fieldName ## _accessor()\
+    static constexpr const char* fieldName ## _id_name(valueType*) noexcept { return #fieldName; }\
+    public:\
+    static decltype(auto) fieldName()\
     {\
-        static const auto field = uc::jni::make_static_field<this_type, valueType>(#fieldName);\
-        return field;\
+        const auto& slot = UC_JNI_ID_SLOT(static_field, valueType, &fieldName ## _id_name);\
+        return slot.accessor.get(uc::jni::internal::bound_class{ slot.cls });\
     }\
-    public:\
-    static decltype(auto) fieldName() { return fieldName ## _accessor().get(); }\
-    static void fieldName(const valueType& val) { fieldName ## _accessor().set(val); }
+    static void fieldName(const valueType& val)\
+    {\
+        const auto& slot = UC_JNI_ID_SLOT(static_field, valueType, &fieldName ## _id_name);\
+        slot.accessor.set(uc::jni::internal::bound_class{ slot.cls }, val);\
+    }
 
 //! define static final field accessor.
 #define UC_JNI_DEFINE_JCLASS_STATIC_FINAL_FIELD(valueType, fieldName) \
@@ -1421,45 +3711,1319 @@ private:
     std::string message;
 };
 
+inline local_ref_in<jthrowable> exception_occurred(JNIEnv* e) noexcept
+{
+    return internal::in_env(e, internal::adopt_local(e->ExceptionOccurred()));
+}
 inline local_ref<jthrowable> exception_occurred() noexcept
 {
-    return local_ref<jthrowable>(env()->ExceptionOccurred());
+    return internal::adopt_local(env()->ExceptionOccurred());
 }
-inline void exception_check()
+inline void exception_check(JNIEnv* e)
 {
-    if (env()->ExceptionCheck()) {
-        auto t = exception_occurred();
-        env()->ExceptionClear();
+    if (e->ExceptionCheck()) {
+        auto t = exception_occurred(e);
+        e->ExceptionClear();
         throw vm_exception(t);
     }
 }
+inline void exception_check()
+{
+    exception_check(env());
+}
 template <typename JThrowable> void throw_new(const char* what)
 {
     env()->ThrowNew(get_class<JThrowable>(), what);
 }
 
+namespace internal
+{
+    template <typename JThrowable> local_ref<jthrowable> new_throwable(JNIEnv* e, const char* what) noexcept
+    {
+        const auto cls = get_class<JThrowable>();
+        const auto ctor = e->GetMethodID(cls, "<init>", "(Ljava/lang/String;)V");
+        auto message = adopt_local(e, e->NewStringUTF(what));
+        auto ret = adopt_local(e, static_cast<jthrowable>(e->NewObject(cls, ctor, message.get())));
+        if (!ret) {
+            // OutOfMemoryError etc. thrown while creating it.
+            ret = adopt_local(e->ExceptionOccurred());
+            e->ExceptionClear();
+        }
+        return ret;
+    }
+    //! the Java throwable for a C++ exception. vm_exception gives back its throwable.
+    inline local_ref<jthrowable> to_throwable(JNIEnv* e, std::exception_ptr ex) noexcept
+    {
+        UC_JNI_DEFINE_JCLASS_ALIAS(Error, java/lang/Error);
+        UC_JNI_DEFINE_JCLASS_ALIAS(RuntimeException, java/lang/RuntimeException);
+        UC_JNI_DEFINE_JCLASS_ALIAS(OutOfMemoryError, java/lang/OutOfMemoryError);
+        try {
+            std::rethrow_exception(ex);
+        } catch (vm_exception& ex) {
+            return internal::new_local(e, ex.throwable.get());
+        } catch (std::runtime_error& ex) {
+            return new_throwable<RuntimeException>(e, ex.what());
+        } catch (std::bad_alloc& ex) {
+            return new_throwable<OutOfMemoryError>(e, ex.what());
+        } catch (std::exception& ex) {
+            return new_throwable<Error>(e, ex.what());
+        } catch (...) {
+            return new_throwable<Error>(e, "Un unidentified C++ exception was thrown");
+        }
+    }
+}
+
 template <class F, class... Args> decltype(auto) exception_guard(F&& func, Args&&... args) noexcept
 {
-    UC_JNI_DEFINE_JCLASS_ALIAS(Error, java/lang/Error);
-    UC_JNI_DEFINE_JCLASS_ALIAS(RuntimeException, java/lang/RuntimeException);
-    UC_JNI_DEFINE_JCLASS_ALIAS(OutOfMemoryError, java/lang/OutOfMemoryError);
+    UC_JNI_TRACE_SCOPE("exception_guard", "jni", nullptr)
     try {
         return func(std::forward<Args>(args)...);
-    } catch (vm_exception& e) {
-        env()->Throw(e.throwable.get());
-    } catch (std::runtime_error& e) {
-        throw_new<RuntimeException>(e.what());
-    } catch (std::bad_alloc& e) {
-        throw_new<OutOfMemoryError>(e.what());
-    } catch (std::exception& e) {
-        throw_new<Error>(e.what());
     } catch (...) {
-        throw_new<Error>("Un unidentified C++ exception was thrown");
+        const auto e = env();
+        e->Throw(internal::to_throwable(e, std::current_exception()).get());
     }
     env()->ExceptionDescribe();
     return decltype(func(std::forward<Args>(args)...))();
 }
 
+//*************************************************************************************************
+// Asynchronous Completion
+//*************************************************************************************************
+namespace internal
+{
+    UC_JNI_DEFINE_JCLASS_ALIAS(CompletableFuture, java/util/concurrent/CompletableFuture);
+
+#define UC_JNI_DEFINE_BOX(valueType, className, sig) \
+    inline local_ref<jobject> box(JNIEnv* e, valueType v)\
+    {\
+        static const auto cls = make_global(find_class(className));\
+        static const auto valueOf = e->GetStaticMethodID(cls.get(), "valueOf", "(" sig ")L" className ";");\
+        return adopt_local(e, e->CallStaticObjectMethod(cls.get(), valueOf, v));\
+    }
+    UC_JNI_DEFINE_BOX(jboolean, "java/lang/Boolean"  , "Z")
+    UC_JNI_DEFINE_BOX(jbyte   , "java/lang/Byte"     , "B")
+    UC_JNI_DEFINE_BOX(jchar   , "java/lang/Character", "C")
+    UC_JNI_DEFINE_BOX(jshort  , "java/lang/Short"    , "S")
+    UC_JNI_DEFINE_BOX(jint    , "java/lang/Integer"  , "I")
+    UC_JNI_DEFINE_BOX(jlong   , "java/lang/Long"     , "J")
+    UC_JNI_DEFINE_BOX(jfloat  , "java/lang/Float"    , "F")
+    UC_JNI_DEFINE_BOX(jdouble , "java/lang/Double"   , "D")
+#undef UC_JNI_DEFINE_BOX
+
+    template <typename V, std::enable_if_t<is_primitive_type<V>::value, std::nullptr_t> = nullptr> local_ref<jobject> boxed(JNIEnv* e, V v)
+    {
+        return box(e, v);
+    }
+    template <typename V, std::enable_if_t<!is_primitive_type<V>::value, std::nullptr_t> = nullptr> jobject boxed(JNIEnv*, const V& v)
+    {
+        return to_native_ref(v);
+    }
+
+    template <typename R> struct future_completer
+    {
+        template <typename F> static void run(JNIEnv* e, const global_ref<CompletableFuture>& future, F& func)
+        {
+            static const auto complete = make_method<CompletableFuture, jboolean(jobject)>("complete");
+            auto&& result = func();
+            auto&& value = type_traits<R>::j_cast(result);
+            complete.call(e, future, to_native_ref(boxed(e, value)));
+        }
+    };
+    template <> struct future_completer<void>
+    {
+        template <typename F> static void run(JNIEnv* e, const global_ref<CompletableFuture>& future, F& func)
+        {
+            static const auto complete = make_method<CompletableFuture, jboolean(jobject)>("complete");
+            func();
+            complete.call(e, future, static_cast<jobject>(nullptr));
+        }
+    };
+    struct thread_executor
+    {
+        template <typename T> void submit(T&& task)
+        {
+            std::thread(std::forward<T>(task)).detach();
+        }
+    };
+    //! run func and complete future with its result, or exceptionally with the throwable exception_guard() would throw.
+    template <typename F> void complete_future(const global_ref<CompletableFuture>& future, F& func) noexcept
+    {
+        using result_type = std::decay_t<decltype(func())>;
+        const auto e = env();
+        try {
+            future_completer<result_type>::run(e, future, func);
+        } catch (...) {
+            static const auto completeExceptionally = make_method<CompletableFuture, jboolean(jthrowable)>("completeExceptionally");
+            try {
+                completeExceptionally.call(e, future, to_throwable(e, std::current_exception()));
+            } catch (...) {
+                e->ExceptionDescribe();
+                e->ExceptionClear();
+            }
+        }
+    }
+}
+
+//! return a java.util.concurrent.CompletableFuture at once and complete it from another thread with func's result.
+//! func runs on executor.submit() (e.g. uc::jni::thread_pool). primitive results are boxed, void completes with null.
+//! exceptions complete the future exceptionally, mapped as exception_guard() maps them.
+template <typename Executor, typename F> local_ref<jobject> async(Executor& executor, F&& func)
+{
+    static const auto ctor = make_constructor<internal::CompletableFuture()>();
+    auto future = ctor();
+    executor.submit([future = make_global(future), func = std::forward<F>(func)]() mutable {
+        internal::complete_future(future, func);
+    });
+    return local_ref<jobject>{ future.release() };
+}
+//! run func on a new native thread, which is detached from the JavaVM when it finishes.
+template <typename F> local_ref<jobject> async(F&& func)
+{
+    internal::thread_executor executor;
+    return async(executor, std::forward<F>(func));
+}
+
+//*************************************************************************************************
+// Thread Pool (define UC_JNI_ENABLE_THREAD_POOL)
+//*************************************************************************************************
+#ifdef UC_JNI_ENABLE_THREAD_POOL
+namespace internal
+{
+    template <typename T> struct is_local_ref : std::false_type {};
+    template <typename T> struct is_local_ref<local_ref<T>> : std::true_type {};
+
+    struct pool_task
+    {
+        virtual ~pool_task() = default;
+        virtual void run() = 0;
+    };
+    template <typename R> struct packaged_pool_task : pool_task
+    {
+        explicit packaged_pool_task(std::packaged_task<R()>&& t) : task(std::move(t)) {}
+        void run() override { task(); }
+        std::packaged_task<R()> task;
+    };
+    //! calls func and turns a pending Java exception into vm_exception.
+    template <typename R> struct checked_invoke
+    {
+        template <typename F> static R invoke(JNIEnv* e, F& func)
+        {
+            R ret = func();
+            exception_check(e);
+            return ret;
+        }
+    };
+    template <> struct checked_invoke<void>
+    {
+        template <typename F> static void invoke(JNIEnv* e, F& func)
+        {
+            func();
+            exception_check(e);
+        }
+    };
+}
+
+//! work-stealing thread pool whose workers stay attached to the JavaVM as named daemon threads.
+//! each task runs in its own local frame. exceptions (including vm_exception) are delivered through the future.
+class thread_pool
+{
+public:
+    explicit thread_pool(std::size_t threadCount = std::thread::hardware_concurrency(), const std::string& name = "uc-jni-pool", jint localCapacity = 16)
+        : queues_(std::max<std::size_t>(threadCount, 1)), localCapacity_(localCapacity)
+    {
+        for (std::size_t i = 0; i < queues_.size(); ++i) {
+            threads_.emplace_back([this, i, threadName = name + "-" + std::to_string(i)] { worker(i, threadName); });
+        }
+    }
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+    //! runs the tasks already submitted, then joins the workers.
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto&& t : threads_) {
+            t.join();
+        }
+    }
+
+    //! a task must not return a local reference; it is released with the task's local frame.
+    template <class F, class... Args> auto submit(F&& func, Args&&... args)
+    {
+        auto bound = std::bind(std::forward<F>(func), std::forward<Args>(args)...);
+        using result_type = decltype(bound());
+        static_assert(!internal::is_local_ref<std::decay_t<result_type>>::value && !is_derived_from_jobject<std::decay_t<result_type>>::value,
+            "a task cannot return a local reference");
+        std::packaged_task<result_type()> task([bound = std::move(bound)]() mutable {
+            return internal::checked_invoke<result_type>::invoke(env(), bound);
+        });
+        auto ret = task.get_future();
+        push(std::unique_ptr<internal::pool_task>(new internal::packaged_pool_task<result_type>(std::move(task))));
+        return ret;
+    }
+    std::size_t size() const noexcept
+    {
+        return threads_.size();
+    }
+
+private:
+    struct worker_queue
+    {
+        std::mutex mutex;
+        std::deque<std::unique_ptr<internal::pool_task>> tasks;
+    };
+    struct worker_id
+    {
+        const thread_pool* pool;
+        std::size_t index;
+    };
+    static worker_id& this_thread_worker() noexcept
+    {
+        thread_local worker_id id { nullptr, 0 };
+        return id;
+    }
+
+    //! a worker pushes to its own queue, other threads distribute round robin.
+    void push(std::unique_ptr<internal::pool_task>&& task)
+    {
+        const auto& self = this_thread_worker();
+        const auto index = (self.pool == this) ? self.index : next_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+        {
+            std::lock_guard<std::mutex> lk(queues_[index].mutex);
+            queues_[index].tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            ++pending_;
+            cv_.notify_one();
+        }
+    }
+    //! pop the newest task of its own queue, or steal the oldest task of another.
+    std::unique_ptr<internal::pool_task> take(std::size_t index)
+    {
+        std::unique_ptr<internal::pool_task> ret;
+        for (std::size_t n = 0; n < queues_.size() && !ret; ++n) {
+            auto& q = queues_[(index + n) % queues_.size()];
+            std::lock_guard<std::mutex> lk(q.mutex);
+            if (q.tasks.empty()) continue;
+            if (n == 0) {
+                ret = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            } else {
+                ret = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+        }
+        if (ret) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            --pending_;
+        }
+        return ret;
+    }
+    void worker(std::size_t index, const std::string& name)
+    {
+        this_thread_worker() = worker_id{ this, index };
+        const auto e = attach_current_thread(name.c_str(), true);
+        for (;;) {
+            if (auto task = take(index)) {
+                // a worker that could not attach drops its tasks; their futures report std::future_errc::broken_promise.
+                if (!e) continue;
+                // without a frame the task still runs; its local_ref objects delete what they own.
+                const bool framed = e->PushLocalFrame(localCapacity_) == 0;
+                if (!framed) e->ExceptionClear();
+                task->run();
+                if (framed) e->PopLocalFrame(nullptr);
+                continue;
+            }
+            std::unique_lock<std::mutex> lk(mutex_);
+            cv_.wait(lk, [this] { return stop_ || pending_ > 0; });
+            if (stop_ && pending_ <= 0) break;
+        }
+        detach_current_thread();
+    }
+
+    std::vector<worker_queue> queues_;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    // signed : a thief may take a task before push() has counted it, so the count briefly drops below zero.
+    std::ptrdiff_t pending_ = 0;
+    bool stop_ = false;
+    std::atomic<std::size_t> next_ { 0 };
+    const jint localCapacity_;
+};
+#endif
+
+//*************************************************************************************************
+// Upcall Channel (define UC_JNI_ENABLE_UPCALL_CHANNEL)
+//*************************************************************************************************
+#ifdef UC_JNI_ENABLE_UPCALL_CHANNEL
+//! batches events posted from any thread and delivers them to Java on one attached thread, column by column.
+//! each field becomes one array (primitive array, or object array for object types); consumer receives (count, arrays...).
+//! a batch is delivered when maxBatch events are pending or the oldest pending event has waited about maxLatency.
+template <typename... Fields> class upcall_channel
+{
+public:
+    using consumer_type = std::function<void(jint, const local_ref<native_array_t<Fields>>&...)>;
+
+    //! capacity (rounded up to a power of 2) bounds the events waiting for delivery.
+    upcall_channel(consumer_type consumer, std::size_t maxBatch = 1024, std::chrono::microseconds maxLatency = std::chrono::milliseconds(1),
+        std::size_t capacity = 65536, const char* name = "uc-jni-upcall")
+        : consumer_(std::move(consumer)), maxBatch_(std::max<std::size_t>(maxBatch, 1)), maxLatency_(maxLatency)
+    {
+        std::size_t size = 2;
+        while (size < std::max(capacity, maxBatch_)) size *= 2;
+        cells_.reset(new cell[size]);
+        mask_ = size - 1;
+        for (std::size_t i = 0; i < size; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        thread_ = std::thread([this, name] { run(name); });
+    }
+    upcall_channel(const upcall_channel&) = delete;
+    upcall_channel& operator=(const upcall_channel&) = delete;
+    //! delivers the pending events, then joins the delivery thread.
+    ~upcall_channel()
+    {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    //! lock-free. returns false if the channel is full.
+    template <typename... Ts> bool try_post(Ts&&... fields)
+    {
+        static_assert(sizeof...(Ts) == sizeof...(Fields), "uc::jni::upcall_channel::post() : wrong number of fields");
+        auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+        cell* c;
+        for (;;) {
+            c = &cells_[pos & mask_];
+            const auto seq = c->sequence.load(std::memory_order_acquire);
+            const auto dif = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (dif == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        c->event = event_type(std::forward<Ts>(fields)...);
+        c->sequence.store(pos + 1, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (idle_.load(std::memory_order_relaxed)) {
+            // the first event after an idle period starts the latency timer.
+            std::lock_guard<std::mutex> lk(mutex_);
+            cv_.notify_one();
+        } else if (pos + 1 - dequeue_pos_.load(std::memory_order_relaxed) >= maxBatch_ && !wakeup_.exchange(true, std::memory_order_relaxed)) {
+            // notify under the lock, or the wakeup may land between the delivery thread's check and its wait.
+            std::lock_guard<std::mutex> lk(mutex_);
+            cv_.notify_one();
+        }
+        return true;
+    }
+    //! waits for space if the channel is full.
+    template <typename... Ts> void post(Ts&&... fields)
+    {
+        while (!try_post(std::forward<Ts>(fields)...)) {
+            std::this_thread::yield();
+        }
+    }
+    //! blocks until every event posted before the call has been delivered.
+    void flush()
+    {
+        const auto target = enqueue_pos_.load(std::memory_order_acquire);
+        std::unique_lock<std::mutex> lk(mutex_);
+        wakeup_.store(true, std::memory_order_relaxed);
+        cv_.notify_all();
+        delivered_cv_.wait(lk, [&] { return delivered_ >= target; });
+    }
+
+private:
+    using event_type = std::tuple<Fields...>;
+    struct cell
+    {
+        std::atomic<std::size_t> sequence;
+        event_type event;
+    };
+
+    bool full_batch() const noexcept
+    {
+        return enqueue_pos_.load(std::memory_order_relaxed) - dequeue_pos_.load(std::memory_order_relaxed) >= maxBatch_;
+    }
+    bool empty() const noexcept
+    {
+        const auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+        return cells_[pos & mask_].sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+    bool pop(event_type& event)
+    {
+        const auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+        auto& c = cells_[pos & mask_];
+        if (c.sequence.load(std::memory_order_acquire) != pos + 1) return false;
+        event = std::move(c.event);
+        c.sequence.store(pos + mask_ + 1, std::memory_order_release);
+        dequeue_pos_.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+    template <std::size_t... I> void append(event_type& event, std::index_sequence<I...>)
+    {
+        (void)std::initializer_list<int>{ (std::get<I>(columns_).push_back(std::move(std::get<I>(event))), 0)... };
+    }
+    template <std::size_t... I> void deliver(JNIEnv* e, jint count, std::index_sequence<I...>)
+    {
+        // without a frame the batch is still delivered; the arrays are local_ref objects and delete themselves.
+        const bool framed = e->PushLocalFrame(static_cast<jint>(sizeof...(Fields) * 2 + 16)) == 0;
+        if (!framed) e->ExceptionClear();
+        exception_guard([&] {
+            consumer_(count, to_jarray(std::get<I>(columns_))...);
+        });
+        if (e->ExceptionCheck()) e->ExceptionClear();
+        if (framed) e->PopLocalFrame(nullptr);
+    }
+    //! moves up to maxBatch events into the columns and delivers them. returns the number of events.
+    std::size_t deliver_batch(JNIEnv* e)
+    {
+        event_type event;
+        std::size_t count = 0;
+        while (count < maxBatch_ && pop(event)) {
+            append(event, std::index_sequence_for<Fields...>());
+            ++count;
+        }
+        if (count > 0) {
+            // a delivery thread that could not attach drops its batches, so flush() still returns.
+            if (e) deliver(e, static_cast<jint>(count), std::index_sequence_for<Fields...>());
+            clear(std::index_sequence_for<Fields...>());
+            std::lock_guard<std::mutex> lk(mutex_);
+            delivered_ += count;
+        }
+        delivered_cv_.notify_all();
+        return count;
+    }
+    template <std::size_t... I> void clear(std::index_sequence<I...>)
+    {
+        (void)std::initializer_list<int>{ (std::get<I>(columns_).clear(), 0)... };
+    }
+    template <std::size_t... I> void reserve(std::index_sequence<I...>)
+    {
+        (void)std::initializer_list<int>{ (std::get<I>(columns_).reserve(maxBatch_), 0)... };
+    }
+    void run(const char* name)
+    {
+        const auto e = attach_current_thread(name, true);
+        reserve(std::index_sequence_for<Fields...>());
+        for (;;) {
+            bool stop;
+            {
+                std::unique_lock<std::mutex> lk(mutex_);
+                // sleep without a timeout while there is nothing to deliver.
+                cv_.wait(lk, [this] {
+                    idle_.store(true, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    return stop_ || wakeup_.load(std::memory_order_relaxed) || !empty();
+                });
+                idle_.store(false, std::memory_order_relaxed);
+                cv_.wait_for(lk, maxLatency_, [this] { return stop_ || wakeup_.load(std::memory_order_relaxed) || full_batch(); });
+                wakeup_.store(false, std::memory_order_relaxed);
+                stop = stop_;
+            }
+            while (deliver_batch(e) == maxBatch_) {
+            }
+            if (stop && enqueue_pos_.load(std::memory_order_acquire) == dequeue_pos_.load(std::memory_order_relaxed)) break;
+        }
+        detach_current_thread();
+    }
+
+    consumer_type consumer_;
+    const std::size_t maxBatch_;
+    const std::chrono::microseconds maxLatency_;
+    std::unique_ptr<cell[]> cells_;
+    std::size_t mask_ = 0;
+    std::atomic<std::size_t> enqueue_pos_ { 0 };
+    std::atomic<std::size_t> dequeue_pos_ { 0 };
+    std::atomic<bool> wakeup_ { false };
+    std::atomic<bool> idle_ { false };
+    std::tuple<std::vector<Fields>...> columns_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable delivered_cv_;
+    std::size_t delivered_ = 0;
+    bool stop_ = false;
+    std::thread thread_;
+};
+#endif
+
+//*************************************************************************************************
+// Ring Buffer (define UC_JNI_ENABLE_RING_BUFFER)
+//*************************************************************************************************
+#ifdef UC_JNI_ENABLE_RING_BUFFER
+//! single-producer / single-consumer queue of variable-length records in a direct ByteBuffer that Java can share.
+//! layout (native byte order):
+//!   [0]   long head : bytes written, stored with release by the producer.
+//!   [64]  long tail : bytes read, stored with release by the consumer.
+//!   [128] data    : records { int length; byte payload[length]; } aligned to 8 bytes.
+//!                   length -1 skips the rest of the data area when a record does not fit before the end.
+//! a record may occupy at most half the data area, so that one always fits in an empty ring wherever head is.
+//! either side may be Java (benchmark/java/.../SpscRingBuffer.java accesses head and tail through VarHandles).
+class spsc_ring
+{
+public:
+    static constexpr std::size_t head_offset = 0;
+    static constexpr std::size_t tail_offset = 64;
+    static constexpr std::size_t data_offset = 128;
+
+    //! how write() and read() wait for the other side.
+    //! busy_poll keeps the core spinning; park spins briefly, then yields, then sleeps up to 1ms.
+    enum class wait_mode { busy_poll, park };
+
+    //! allocates a direct buffer with "capacity" data bytes (rounded up to a power of 2).
+    explicit spsc_ring(std::size_t capacity)
+    {
+        std::size_t size = 64;
+        while (size < capacity) size *= 2;
+        check_lock_free();
+        owned_ = new_direct_buffer<std::uint8_t>(data_offset + size);
+        base_ = address(owned_);
+        std::fill(base_, base_ + data_offset, std::uint8_t{});
+        capacity_ = size;
+    }
+    //! shares a zero-filled direct ByteBuffer (ByteBuffer.allocateDirect()) allocated by Java.
+    //! its address must be 8-byte aligned and its capacity data_offset + a power of 2.
+    explicit spsc_ring(jobject buffer) : shared_(buffer)
+    {
+        check_lock_free();
+        base_ = static_cast<std::uint8_t*>(env()->GetDirectBufferAddress(buffer));
+        const auto size = env()->GetDirectBufferCapacity(buffer) - static_cast<jlong>(data_offset);
+        if (!base_ || reinterpret_cast<std::uintptr_t>(base_) % 8 != 0 || size < 64 || (size & (size - 1)) != 0) {
+            throw std::invalid_argument("uc::jni::spsc_ring : unsupported buffer");
+        }
+        capacity_ = static_cast<std::size_t>(size);
+    }
+    spsc_ring(const spsc_ring&) = delete;
+    spsc_ring& operator=(const spsc_ring&) = delete;
+
+    //! the shared java.nio.ByteBuffer.
+    jobject buffer() const noexcept
+    {
+        return owned_ ? owned_.get() : shared_.get();
+    }
+    //! data bytes. a record occupies (4 + size) rounded up to 8 bytes.
+    std::size_t capacity() const noexcept
+    {
+        return capacity_;
+    }
+    //! the largest payload a record can hold (capacity() / 2 - 4 bytes).
+    std::size_t max_size() const noexcept
+    {
+        return capacity_ / 2 - sizeof(std::int32_t);
+    }
+
+    //! producer. constructs a record of "size" bytes in place with fill(void* payload).
+    //! returns false if the ring is full. throws std::length_error if size exceeds max_size().
+    template <typename F> bool try_write(std::size_t size, F&& fill)
+    {
+        if (size > max_size()) throw std::length_error("uc::jni::spsc_ring : record too large");
+        const auto recordSize = record_size(size);
+        auto head = index(head_offset).load(std::memory_order_relaxed);
+        auto pos = static_cast<std::size_t>(head) & (capacity_ - 1);
+        const auto padding = (pos + recordSize > capacity_) ? capacity_ - pos : 0;
+        const auto required = static_cast<jlong>(padding + recordSize);
+        if (head + required - tailCache_ > static_cast<jlong>(capacity_)) {
+            tailCache_ = index(tail_offset).load(std::memory_order_acquire);
+            if (head + required - tailCache_ > static_cast<jlong>(capacity_)) return false;
+        }
+        if (padding) {
+            store_length(pos, -1);
+            head += static_cast<jlong>(padding);
+            pos = 0;
+        }
+        store_length(pos, static_cast<std::int32_t>(size));
+        fill(static_cast<void*>(base_ + data_offset + pos + sizeof(std::int32_t)));
+        index(head_offset).store(head + static_cast<jlong>(recordSize), std::memory_order_release);
+        return true;
+    }
+    bool try_write(const void* data, std::size_t size)
+    {
+        return try_write(size, [&](void* dst) { std::memcpy(dst, data, size); });
+    }
+    //! waits while the ring is full.
+    template <typename F> void write(std::size_t size, F&& fill, wait_mode mode = wait_mode::park)
+    {
+        for (unsigned attempt = 0; !try_write(size, fill); ++attempt) {
+            pause(mode, attempt);
+        }
+    }
+    void write(const void* data, std::size_t size, wait_mode mode = wait_mode::park)
+    {
+        write(size, [&](void* dst) { std::memcpy(dst, data, size); }, mode);
+    }
+
+    //! consumer. passes the oldest record to f(const void* payload, size_t size); it is valid only during the call.
+    //! returns false if the ring is empty.
+    template <typename F> bool try_read(F&& f)
+    {
+        auto tail = index(tail_offset).load(std::memory_order_relaxed);
+        if (tail == headCache_) {
+            headCache_ = index(head_offset).load(std::memory_order_acquire);
+            if (tail == headCache_) return false;
+        }
+        auto pos = static_cast<std::size_t>(tail) & (capacity_ - 1);
+        auto size = load_length(pos);
+        if (size < 0) {
+            tail += static_cast<jlong>(capacity_ - pos);
+            pos = 0;
+            size = load_length(pos);
+        }
+        f(static_cast<const void*>(base_ + data_offset + pos + sizeof(std::int32_t)), static_cast<std::size_t>(size));
+        index(tail_offset).store(tail + static_cast<jlong>(record_size(static_cast<std::size_t>(size))), std::memory_order_release);
+        return true;
+    }
+    //! waits while the ring is empty.
+    template <typename F> void read(F&& f, wait_mode mode = wait_mode::park)
+    {
+        for (unsigned attempt = 0; !try_read(f); ++attempt) {
+            pause(mode, attempt);
+        }
+    }
+
+private:
+    using index_type = std::atomic<jlong>;
+    static_assert(sizeof(index_type) == sizeof(jlong) && alignof(index_type) <= 8, "uc::jni::spsc_ring : jlong atomics must be plain 8-byte words");
+#ifdef __cpp_lib_atomic_is_always_lock_free
+    static_assert(index_type::is_always_lock_free, "uc::jni::spsc_ring : jlong atomics must be lock-free");
+#endif
+
+    // Java accesses head and tail with plain 8-byte atomics, so a lock-based std::atomic would not synchronize with it.
+    static void check_lock_free()
+    {
+        if (!index_type().is_lock_free()) throw std::runtime_error("uc::jni::spsc_ring : jlong atomics are not lock-free");
+    }
+
+    static std::size_t record_size(std::size_t size) noexcept
+    {
+        return (sizeof(std::int32_t) + size + 7) & ~static_cast<std::size_t>(7);
+    }
+    index_type& index(std::size_t offset) const noexcept
+    {
+        return *reinterpret_cast<index_type*>(base_ + offset);
+    }
+    void store_length(std::size_t pos, std::int32_t size) noexcept
+    {
+        std::memcpy(base_ + data_offset + pos, &size, sizeof(size));
+    }
+    std::int32_t load_length(std::size_t pos) const noexcept
+    {
+        std::int32_t size;
+        std::memcpy(&size, base_ + data_offset + pos, sizeof(size));
+        return size;
+    }
+    static void pause(wait_mode mode, unsigned attempt)
+    {
+        if (mode == wait_mode::busy_poll || attempt < 64) {
+            if (attempt % 64 == 63) std::this_thread::yield();
+        } else if (attempt < 128) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(1 << std::min(attempt - 128, 10u)));
+        }
+    }
+
+    direct_buffer<std::uint8_t> owned_;
+    global_ref<jobject> shared_;
+    std::uint8_t* base_ = nullptr;
+    std::size_t capacity_ = 0;
+    // each side caches the other side's index on its own cache line.
+    alignas(64) jlong tailCache_ = 0;
+    alignas(64) jlong headCache_ = 0;
+};
+#endif
+
+//*************************************************************************************************
+// Handle Table (define UC_JNI_ENABLE_HANDLE_TABLE)
+//*************************************************************************************************
+#ifdef UC_JNI_ENABLE_HANDLE_TABLE
+//! keeps Java objects reachable in Object[] slabs (one global reference per slab) and names them by integer handles.
+//! a handle is (generation << 32 | slot + 1), so 0 is never a valid handle and a removed handle stops resolving
+//! even after its slot is reused. add(), get() and remove() call no NewGlobalRef() and take no lock
+//! except when a new slab is allocated. handles can be passed between threads freely.
+template <typename JType = jobject> class handle_table
+{
+public:
+    using handle_type = std::uint64_t;
+
+    //! room for slabSize * maxSlabs objects. slabs are allocated on demand.
+    explicit handle_table(std::uint32_t slabSize = 1024, std::uint32_t maxSlabs = 4096)
+        : slabSize_(std::max<std::uint32_t>(slabSize, 1)), maxSlabs_(std::max<std::uint32_t>(maxSlabs, 1)), slabs_(new std::atomic<slab*>[maxSlabs_])
+    {
+        for (std::uint32_t i = 0; i < maxSlabs_; ++i) {
+            slabs_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+    handle_table(const handle_table&) = delete;
+    handle_table& operator=(const handle_table&) = delete;
+
+    //! throws std::length_error if the table is full.
+    template <typename T> handle_type add(const T& obj)
+    {
+        const auto slot = acquire_slot();
+        auto& s = *slabs_[slot / slabSize_].load(std::memory_order_acquire);
+        env()->SetObjectArrayElement(s.objects.get(), static_cast<jsize>(slot % slabSize_), to_native_ref(obj));
+        size_.fetch_add(1, std::memory_order_relaxed);
+        const auto generation = s.slots[slot % slabSize_].generation.load(std::memory_order_relaxed);
+        return (static_cast<handle_type>(generation) << 32) | (slot + 1);
+    }
+    //! returns null if the handle has been removed.
+    local_ref<JType> get(handle_type h) const
+    {
+        const auto s = find(h);
+        if (!s) return {};
+        const auto offset = static_cast<jsize>((static_cast<std::uint32_t>(h) - 1) % slabSize_);
+        auto ret = internal::adopt_local(static_cast<JType>(env()->GetObjectArrayElement(s->objects.get(), offset)));
+        // the slot may have been removed and reused while the element was read.
+        return find(h) ? std::move(ret) : local_ref<JType>{};
+    }
+    bool contains(handle_type h) const noexcept
+    {
+        return find(h) != nullptr;
+    }
+    //! returns false if the handle has already been removed.
+    bool remove(handle_type h)
+    {
+        const auto s = find(h);
+        if (!s) return false;
+        const auto slot = static_cast<std::uint32_t>(h) - 1;
+        auto generation = static_cast<std::uint32_t>(h >> 32);
+        if (!s->slots[slot % slabSize_].generation.compare_exchange_strong(generation, generation + 1, std::memory_order_acq_rel)) return false;
+        env()->SetObjectArrayElement(s->objects.get(), static_cast<jsize>(slot % slabSize_), nullptr);
+        release_slot(*s, slot);
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+    //! objects in the table.
+    std::size_t size() const noexcept
+    {
+        return size_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct slot_state
+    {
+        std::atomic<std::uint32_t> generation { 0 };
+        std::atomic<std::uint32_t> next { 0 };    //!< free list link (slot + 1, 0 : end)
+    };
+    struct slab
+    {
+        unique_global_ref<array<jobject>> objects;
+        std::unique_ptr<slot_state[]> slots;
+    };
+
+    const slab* find(handle_type h) const noexcept
+    {
+        const auto slot = static_cast<std::uint32_t>(h) - 1;
+        if (static_cast<std::uint32_t>(h) == 0 || slot / slabSize_ >= maxSlabs_) return nullptr;
+        const auto s = slabs_[slot / slabSize_].load(std::memory_order_acquire);
+        if (!s || s->slots[slot % slabSize_].generation.load(std::memory_order_acquire) != static_cast<std::uint32_t>(h >> 32)) return nullptr;
+        return s;
+    }
+    std::uint32_t acquire_slot()
+    {
+        // Treiber stack; the upper 32 bits of free_ count pops and pushes against ABA.
+        auto head = free_.load(std::memory_order_acquire);
+        while (static_cast<std::uint32_t>(head) != 0) {
+            const auto slot = static_cast<std::uint32_t>(head) - 1;
+            const auto next = slabs_[slot / slabSize_].load(std::memory_order_relaxed)->slots[slot % slabSize_].next.load(std::memory_order_relaxed);
+            if (free_.compare_exchange_weak(head, (((head >> 32) + 1) << 32) | next, std::memory_order_acquire)) return slot;
+        }
+        auto slot = unused_.load(std::memory_order_relaxed);
+        do {
+            if (slot / slabSize_ >= maxSlabs_) throw std::length_error("uc::jni::handle_table : full");
+        } while (!unused_.compare_exchange_weak(slot, slot + 1, std::memory_order_relaxed));
+        if (!slabs_[slot / slabSize_].load(std::memory_order_acquire)) allocate_slab(slot / slabSize_);
+        return slot;
+    }
+    void release_slot(const slab& s, std::uint32_t slot) noexcept
+    {
+        auto head = free_.load(std::memory_order_relaxed);
+        do {
+            s.slots[slot % slabSize_].next.store(static_cast<std::uint32_t>(head), std::memory_order_relaxed);
+        } while (!free_.compare_exchange_weak(head, (((head >> 32) + 1) << 32) | (slot + 1), std::memory_order_release, std::memory_order_relaxed));
+    }
+    void allocate_slab(std::uint32_t index)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (slabs_[index].load(std::memory_order_relaxed)) return;
+        std::unique_ptr<slab> s(new slab{ make_unique_global(new_array<jobject>(static_cast<jsize>(slabSize_))), std::unique_ptr<slot_state[]>(new slot_state[slabSize_]) });
+        if (!s->objects) {
+            exception_check();
+            throw std::bad_alloc();
+        }
+        slabs_[index].store(s.get(), std::memory_order_release);
+        owned_.push_back(std::move(s));
+    }
+
+    const std::uint32_t slabSize_;
+    const std::uint32_t maxSlabs_;
+    std::unique_ptr<std::atomic<slab*>[]> slabs_;
+    std::atomic<std::uint64_t> free_ { 0 };
+    std::atomic<std::uint32_t> unused_ { 0 };
+    std::atomic<std::size_t> size_ { 0 };
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<slab>> owned_;
+};
+#endif
+
+//*************************************************************************************************
+// Peer Registry (define UC_JNI_ENABLE_PEER_REGISTRY)
+//*************************************************************************************************
+#ifdef UC_JNI_ENABLE_PEER_REGISTRY
+//! maps native peers (std::shared_ptr<T>) to jlong handles that Java code can keep in a long field.
+//! a handle is (generation << 32 | slot + 1): a released handle never resolves again, even after its slot is reused.
+//! get() is lock-free. a peer attach()ed to a Java owner is released by a cleaner thread in batches
+//! once the owner becomes phantom reachable (the mechanism java.lang.ref.Cleaner is built on).
+template <typename T> class peer_registry
+{
+public:
+    using peer_type = std::shared_ptr<T>;
+
+    //! room for slabSize * maxSlabs peers. slabs are allocated on demand.
+    explicit peer_registry(std::uint32_t slabSize = 1024, std::uint32_t maxSlabs = 4096)
+        : slabSize_(std::max<std::uint32_t>(slabSize, 1)), maxSlabs_(std::max<std::uint32_t>(maxSlabs, 1)), slabs_(new std::atomic<slot*>[maxSlabs_])
+    {
+        for (std::uint32_t i = 0; i < maxSlabs_; ++i) {
+            slabs_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+    peer_registry(const peer_registry&) = delete;
+    peer_registry& operator=(const peer_registry&) = delete;
+    //! stops the cleaner thread. peers still registered are released with the registry.
+    ~peer_registry()
+    {
+        if (thread_.joinable()) {
+            stop_.store(true, std::memory_order_relaxed);
+            // wake ReferenceQueue.remove() with a reference nobody else knows about.
+            auto e = env();
+            auto wakeup = internal::adopt_local(e->NewObject(phantom_class(), phantom_init(), queue_.get(), queue_.get()));
+            e->CallBooleanMethod(wakeup.get(), enqueue_id());
+            thread_.join();
+        }
+    }
+
+    //! the peer lives until release(). throws std::length_error if the registry is full.
+    jlong add(peer_type peer)
+    {
+        return publish(std::move(peer), nullptr);
+    }
+    //! the peer lives until release(), or until owner becomes unreachable.
+    template <typename JType> jlong attach(const JType& owner, peer_type peer)
+    {
+        auto e = env();
+        start_cleaner(e);
+        auto cleanup = make_unique_global(internal::adopt_local(e->NewObject(phantom_class(), phantom_init(), to_native_ref(owner), queue_.get())));
+        if (!cleanup) {
+            exception_check();
+            throw std::bad_alloc();
+        }
+        return publish(std::move(peer), std::move(cleanup));
+    }
+    //! returns null if the handle has been released.
+    peer_type get(jlong h) const
+    {
+        const auto s = find(h);
+        if (!s) return {};
+        // pin the slot so that release() does not reset the peer while it is copied.
+        auto state = s->state.load(std::memory_order_relaxed);
+        do {
+            if ((state >> 32) != (static_cast<std::uint64_t>(h) >> 32) || !(state & live_bit)) return {};
+        } while (!s->state.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed));
+        auto ret = s->peer;
+        s->state.fetch_sub(1, std::memory_order_release);
+        return ret;
+    }
+    bool contains(jlong h) const noexcept
+    {
+        const auto s = find(h);
+        if (!s) return false;
+        const auto state = s->state.load(std::memory_order_acquire);
+        return (state >> 32) == (static_cast<std::uint64_t>(h) >> 32) && (state & live_bit);
+    }
+    //! returns false if the handle has already been released.
+    bool release(jlong h)
+    {
+        return retire(h, false);
+    }
+    //! releases the peers whose owners have been collected, on the calling thread. returns the number released.
+    std::size_t collect(std::size_t maxCount = 256)
+    {
+        return started_.load(std::memory_order_acquire) ? collect(env(), nullptr, maxCount) : 0;
+    }
+    //! peers in the registry.
+    std::size_t size() const noexcept
+    {
+        return size_.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr std::uint64_t live_bit = 0x80000000u;
+    static constexpr std::uint64_t pin_mask = 0x7fffffffu;
+
+    struct slot
+    {
+        std::atomic<std::uint64_t> state { 0 };   //!< generation << 32 | live_bit | pins
+        std::atomic<std::uint32_t> next { 0 };    //!< free list link (slot + 1, 0 : end)
+        jint hash = 0;                            //!< identity_hash(cleanup)
+        peer_type peer;
+        unique_global_ref<jobject> cleanup;       //!< PhantomReference to the owner
+    };
+
+    static jclass phantom_class()
+    {
+        static const auto cls = make_global(find_class("java/lang/ref/PhantomReference"));
+        return cls.get();
+    }
+    static jmethodID phantom_init()
+    {
+        static const auto id = env()->GetMethodID(phantom_class(), "<init>", "(Ljava/lang/Object;Ljava/lang/ref/ReferenceQueue;)V");
+        return id;
+    }
+    static jmethodID enqueue_id()
+    {
+        static const auto id = env()->GetMethodID(phantom_class(), "enqueue", "()Z");
+        return id;
+    }
+    static jclass queue_class()
+    {
+        static const auto cls = make_global(find_class("java/lang/ref/ReferenceQueue"));
+        return cls.get();
+    }
+
+    slot* find(jlong h) const noexcept
+    {
+        const auto index = static_cast<std::uint32_t>(h) - 1;
+        if (static_cast<std::uint32_t>(h) == 0 || index / slabSize_ >= maxSlabs_) return nullptr;
+        const auto s = slabs_[index / slabSize_].load(std::memory_order_acquire);
+        return s ? &s[index % slabSize_] : nullptr;
+    }
+    jlong publish(peer_type peer, unique_global_ref<jobject> cleanup)
+    {
+        const auto index = acquire_slot();
+        auto& s = slabs_[index / slabSize_].load(std::memory_order_acquire)[index % slabSize_];
+        const auto generation = s.state.load(std::memory_order_relaxed) >> 32;
+        const auto h = static_cast<jlong>((generation << 32) | (index + 1));
+        s.peer = std::move(peer);
+        if (cleanup) {
+            s.hash = identity_hash(cleanup);
+            s.cleanup = std::move(cleanup);
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.emplace(s.hash, h);
+        }
+        s.state.store((generation << 32) | live_bit, std::memory_order_release);
+        size_.fetch_add(1, std::memory_order_relaxed);
+        return h;
+    }
+    //! "unlisted" : the collector has already removed h from pending_.
+    bool retire(jlong h, bool unlisted)
+    {
+        const auto s = find(h);
+        if (!s) return false;
+        auto state = s->state.load(std::memory_order_relaxed);
+        do {
+            if ((state >> 32) != (static_cast<std::uint64_t>(h) >> 32) || !(state & live_bit)) return false;
+        } while (!s->state.compare_exchange_weak(state, (((state >> 32) + 1) << 32) | (state & pin_mask), std::memory_order_acq_rel, std::memory_order_relaxed));
+        // get() copies the peer under a pin; wait for the copies in flight.
+        while (s->state.load(std::memory_order_acquire) & pin_mask) {
+            std::this_thread::yield();
+        }
+        if (s->cleanup && !unlisted) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const auto range = pending_.equal_range(s->hash);
+            for (auto itr = range.first; itr != range.second; ++itr) {
+                if (itr->second == h) {
+                    pending_.erase(itr);
+                    break;
+                }
+            }
+        }
+        // an unreachable PhantomReference is never enqueued.
+        s->cleanup.reset();
+        s->peer.reset();
+        release_slot(*s, static_cast<std::uint32_t>(h) - 1);
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+    //! drains up to maxCount enqueued references (first, if given, has already been dequeued) and releases their peers.
+    std::size_t collect(JNIEnv* e, jobject first, std::size_t maxCount)
+    {
+        static const auto poll = e->GetMethodID(queue_class(), "poll", "()Ljava/lang/ref/Reference;");
+        std::vector<local_ref<jobject>> refs;
+        if (first) refs.push_back(internal::adopt_local(first));
+        while (refs.size() < maxCount) {
+            auto r = internal::adopt_local(e->CallObjectMethod(queue_.get(), poll));
+            if (!r) break;
+            refs.push_back(std::move(r));
+        }
+        std::vector<std::pair<jint, jobject>> keys;
+        keys.reserve(refs.size());
+        for (auto&& r : refs) {
+            keys.emplace_back(identity_hash(r), r.get());
+        }
+        std::vector<jlong> handles;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto&& key : keys) {
+                const auto range = pending_.equal_range(key.first);
+                for (auto itr = range.first; itr != range.second; ++itr) {
+                    if (e->IsSameObject(find(itr->second)->cleanup.get(), key.second)) {
+                        handles.push_back(itr->second);
+                        pending_.erase(itr);
+                        break;
+                    }
+                }
+            }
+        }
+        std::size_t count = 0;
+        for (auto h : handles) {
+            if (retire(h, true)) ++count;
+        }
+        return count;
+    }
+    void start_cleaner(JNIEnv* e)
+    {
+        if (started_.load(std::memory_order_acquire)) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (started_.load(std::memory_order_relaxed)) return;
+        static const auto init = e->GetMethodID(queue_class(), "<init>", "()V");
+        queue_ = make_unique_global(internal::adopt_local(e->NewObject(queue_class(), init)));
+        if (!queue_) {
+            exception_check();
+            throw std::bad_alloc();
+        }
+        thread_ = std::thread([this] { run(); });
+        started_.store(true, std::memory_order_release);
+    }
+    void run()
+    {
+        const auto e = attach_current_thread("uc-jni-cleaner", true);
+        const auto remove = e->GetMethodID(queue_class(), "remove", "()Ljava/lang/ref/Reference;");
+        while (!stop_.load(std::memory_order_relaxed)) {
+            // this thread never returns to Java; the frame encloses the dequeued reference too, so popping it frees every local.
+            if (e->PushLocalFrame(16) != 0) {
+                e->ExceptionClear();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            const auto r = e->CallObjectMethod(queue_.get(), remove);
+            if (e->ExceptionCheck()) {
+                e->ExceptionClear();
+            } else {
+                exception_guard([&] {
+                    collect(e, r, 256);
+                });
+                if (e->ExceptionCheck()) e->ExceptionClear();
+            }
+            e->PopLocalFrame(nullptr);
+        }
+        detach_current_thread();
+    }
+    std::uint32_t acquire_slot()
+    {
+        // Treiber stack; the upper 32 bits of free_ count pops and pushes against ABA.
+        auto head = free_.load(std::memory_order_acquire);
+        while (static_cast<std::uint32_t>(head) != 0) {
+            const auto index = static_cast<std::uint32_t>(head) - 1;
+            const auto next = slabs_[index / slabSize_].load(std::memory_order_relaxed)[index % slabSize_].next.load(std::memory_order_relaxed);
+            if (free_.compare_exchange_weak(head, (((head >> 32) + 1) << 32) | next, std::memory_order_acquire)) return index;
+        }
+        auto index = unused_.load(std::memory_order_relaxed);
+        do {
+            if (index / slabSize_ >= maxSlabs_) throw std::length_error("uc::jni::peer_registry : full");
+        } while (!unused_.compare_exchange_weak(index, index + 1, std::memory_order_relaxed));
+        if (!slabs_[index / slabSize_].load(std::memory_order_acquire)) allocate_slab(index / slabSize_);
+        return index;
+    }
+    void release_slot(slot& s, std::uint32_t index) noexcept
+    {
+        auto head = free_.load(std::memory_order_relaxed);
+        do {
+            s.next.store(static_cast<std::uint32_t>(head), std::memory_order_relaxed);
+        } while (!free_.compare_exchange_weak(head, (((head >> 32) + 1) << 32) | (index + 1), std::memory_order_release, std::memory_order_relaxed));
+    }
+    void allocate_slab(std::uint32_t index)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (slabs_[index].load(std::memory_order_relaxed)) return;
+        std::unique_ptr<slot[]> s(new slot[slabSize_]);
+        slabs_[index].store(s.get(), std::memory_order_release);
+        owned_.push_back(std::move(s));
+    }
+
+    const std::uint32_t slabSize_;
+    const std::uint32_t maxSlabs_;
+    std::unique_ptr<std::atomic<slot*>[]> slabs_;
+    std::atomic<std::uint64_t> free_ { 0 };
+    std::atomic<std::uint32_t> unused_ { 0 };
+    std::atomic<std::size_t> size_ { 0 };
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<slot[]>> owned_;
+    std::unordered_multimap<jint, jlong> pending_;    //!< identity_hash(cleanup) -> handle
+    unique_global_ref<jobject> queue_;                //!< ReferenceQueue
+    std::atomic<bool> started_ { false };
+    std::atomic<bool> stop_ { false };
+    std::thread thread_;
+};
+#endif
+
+//*************************************************************************************************
+// Coroutine Support (C++20)
+//*************************************************************************************************
+#ifdef __cpp_impl_coroutine
+namespace internal
+{
+    UC_JNI_DEFINE_JCLASS_ALIAS(BiConsumer, java/util/function/BiConsumer);
+    UC_JNI_DEFINE_JCLASS_ALIAS(CompletionStage, java/util/concurrent/CompletionStage);
+    UC_JNI_DEFINE_JCLASS_ALIAS(CompletionException, java/util/concurrent/CompletionException);
+
+    //! shared by a future_awaiter and its JCompletion callback, so that either may go first.
+    struct completion_target
+    {
+        virtual ~completion_target() = default;
+        virtual void complete(jobject value, jthrowable error) = 0;
+    };
+    struct completion_class
+    {
+        jclass cls{};
+        jmethodID ctor{};
+        jfieldID handle{};
+    };
+    inline completion_class& completion_class_instance() noexcept
+    {
+        static completion_class instance;
+        return instance;
+    }
+    inline void completion_accept(JNIEnv* e, jobject self, jobject value, jthrowable error)
+    {
+        env_scope scope(e);
+        exception_guard([&] {
+            // whenComplete() runs the callback once; it owns one reference to the target.
+            const auto handle = e->GetLongField(self, completion_class_instance().handle);
+            const std::unique_ptr<std::shared_ptr<completion_target>> target(reinterpret_cast<std::shared_ptr<completion_target>*>(static_cast<std::intptr_t>(handle)));
+            (*target)->complete(value, error);
+        });
+    }
+}
+
+//! bind the native half of the completion callback to JCompletion, a Java class declared as
+//! final class JCompletion implements BiConsumer<Object, Throwable> { final long handle; JCompletion(long handle) {...} public native void accept(Object value, Throwable error); }
+template <typename JCompletion> bool register_completion_callback()
+{
+    auto& c = internal::completion_class_instance();
+    c.cls = get_class<JCompletion>();
+    c.ctor = get_method_id<JCompletion, void(jlong)>("<init>");
+    c.handle = get_field_id<JCompletion, jlong>("handle");
+    const JNINativeMethod methods[] { make_native_method("accept", &internal::completion_accept) };
+    return register_natives<JCompletion>(methods);
+}
+
+//! co_await a java.util.concurrent.CompletionStage without blocking the thread.
+//! the coroutine is resumed by the thread that completes the stage, or by executor.submit() if an executor is given.
+//! exceptional completion is thrown as vm_exception (CompletionException is unwrapped).
+//! local references do not survive the suspension; keep global_ref across co_await.
+//! destroying the coroutine while it is suspended cancels the resumption; the stage may still complete later.
+template <typename T = jobject, typename Executor = void> class future_awaiter
+{
+public:
+    future_awaiter(jobject future, Executor* executor) : future_(make_global(future)), state_(std::make_shared<state>(executor))
+    {
+    }
+    future_awaiter(future_awaiter&&) = default;
+    ~future_awaiter()
+    {
+        if (state_) state_->progress.store(cancelled, std::memory_order_release);
+    }
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        static const auto whenComplete = make_method<internal::CompletionStage, internal::CompletionStage(internal::BiConsumer)>("whenComplete");
+        const auto& c = internal::completion_class_instance();
+        if (!c.ctor) throw std::logic_error("uc::jni::register_completion_callback() has not been called");
+        state_->handle = handle;
+        const auto e = env();
+        std::unique_ptr<std::shared_ptr<internal::completion_target>> target(new std::shared_ptr<internal::completion_target>(state_));
+        auto callback = internal::adopt_local(e, e->NewObject(c.cls, c.ctor, static_cast<jlong>(reinterpret_cast<std::intptr_t>(target.get()))));
+        exception_check(e);
+        target.release();
+        whenComplete.call(e, future_, callback);
+        // the stage may already be complete; then whenComplete() has run the callback on this thread.
+        auto expected = static_cast<int>(running);
+        return state_->progress.compare_exchange_strong(expected, suspended, std::memory_order_acq_rel);
+    }
+    decltype(auto) await_resume()
+    {
+        const auto& error = state_->error;
+        if (error) {
+            static const auto getCause = make_method<jthrowable, jthrowable()>("getCause");
+            auto cause = is_instance_of<internal::CompletionException>(error) ? getCause(error) : local_ref<jthrowable>();
+            if (cause) throw vm_exception(cause);
+            throw vm_exception(error);
+        }
+        if constexpr (!std::is_void_v<T>) {
+            return internal::c_cast<T>(env(), static_cast<typename type_traits<T>::jvalue_type>(state_->value.get()), nullptr);
+        }
+    }
+
+private:
+    enum { running, suspended, completed, cancelled };
+    struct state : internal::completion_target
+    {
+        explicit state(Executor* executor) noexcept : executor(executor)
+        {
+        }
+        void complete(jobject v, jthrowable err) override
+        {
+            if (v) value = make_global(v);
+            if (err) error = make_global(err);
+            if (progress.exchange(completed, std::memory_order_acq_rel) != suspended) return;
+            if constexpr (std::is_void_v<Executor>) {
+                handle.resume();
+            } else {
+                executor->submit([h = handle] { h.resume(); });
+            }
+        }
+
+        Executor* executor;
+        std::coroutine_handle<> handle;
+        global_ref<jobject> value;
+        global_ref<jthrowable> error;
+        std::atomic<int> progress { running };
+    };
+
+    global_ref<jobject> future_;
+    std::shared_ptr<state> state_;
+};
+template <typename T = jobject, typename JFuture> future_awaiter<T> awaitable(const JFuture& future)
+{
+    return future_awaiter<T>(to_native_ref(future), nullptr);
+}
+template <typename T = jobject, typename JFuture, typename Executor> future_awaiter<T, Executor> awaitable(const JFuture& future, Executor& executor)
+{
+    return future_awaiter<T, Executor>(to_native_ref(future), &executor);
+}
+#endif
+
+#undef UC_JNI_CALL_SITE_MEMBER
+#undef UC_JNI_CALL_SITE_TIMER
+#undef UC_JNI_CALL_SITE
+#undef UC_JNI_REF_STATS
+#undef UC_JNI_COPY_STATS
+
 }
 }
 #endif
\ No newline at end of file